@@ -0,0 +1,161 @@
+#include "Transports.h"
+#include <YALF/YALF.h>
+#include <asio.hpp>
+#include <atomic>
+#include <deque>
+#include <format>
+#include <memory>
+
+namespace RAP::Transport {
+
+// One side of an async paired transport.
+// All members except `timeout` are only accessed on the endpoint's io_context thread.
+class AsyncIpcEndpoint : public std::enable_shared_from_this<AsyncIpcEndpoint>
+{
+private:
+    struct PendingRecv {
+        IAsyncWireTransport::RecvHandler handler;
+        std::chrono::steady_clock::time_point deadline;
+    };
+public:
+    explicit AsyncIpcEndpoint(asio::io_context& io_ctx_)
+        : io_ctx(io_ctx_)
+        , timeout(std::chrono::years(1))
+        , timer(io_ctx_)
+    {}
+
+    void deliver(Buffer buffer)
+    {
+        if (this->pending.empty()) {
+            this->inbox.push_back(std::move(buffer));
+            return;
+        }
+        auto handler = std::move(this->pending.front().handler);
+        this->pending.pop_front();
+        this->armTimer();
+        handler(nullptr, std::move(buffer));
+    }
+    void startRecv(IAsyncWireTransport::RecvHandler handler)
+    {
+        if (!this->inbox.empty()) {
+            auto buffer = std::move(this->inbox.front());
+            this->inbox.pop_front();
+            handler(nullptr, std::move(buffer));
+            return;
+        }
+        auto const deadline = std::chrono::steady_clock::now() + this->timeout.load();
+        this->pending.push_back(PendingRecv{ .handler = std::move(handler), .deadline = deadline });
+        if (this->pending.size() == 1)
+            this->armTimer();
+    }
+    void cancelAll()
+    {
+        this->timer.cancel();
+        auto pending_ = std::exchange(this->pending, {});
+        for (auto& p : pending_)
+            p.handler(std::make_exception_ptr(TransportCancelledException()), Buffer{});
+    }
+
+    asio::io_context& io_ctx;
+    std::atomic<std::chrono::microseconds> timeout;
+
+private:
+    void armTimer()
+    {
+        if (this->pending.empty()) {
+            this->timer.cancel();
+            return;
+        }
+        this->timer.expires_at(this->pending.front().deadline);
+        this->timer.async_wait([self = this->shared_from_this()](std::error_code const& ec) {
+            if (ec == asio::error::operation_aborted)
+                return;
+            auto const now = std::chrono::steady_clock::now();
+            while (!self->pending.empty() && self->pending.front().deadline <= now) {
+                auto handler = std::move(self->pending.front().handler);
+                self->pending.pop_front();
+                handler(std::make_exception_ptr(TransportTimeoutException()), Buffer{});
+            }
+            self->armTimer();
+        });
+    }
+
+private:
+    asio::steady_timer timer;
+    std::deque<Buffer> inbox;
+    std::deque<PendingRecv> pending;
+};
+
+class AsyncPairedIpcTransport : public IAsyncWireTransport
+{
+public:
+    AsyncPairedIpcTransport(std::shared_ptr<AsyncIpcEndpoint> local_, std::shared_ptr<AsyncIpcEndpoint> remote_, size_t max_message_size_, bool log_ = false)
+        : local(std::move(local_))
+        , remote(std::move(remote_))
+        , max_message_size(max_message_size_)
+        , log(log_)
+    {}
+    ~AsyncPairedIpcTransport()
+    {
+        asio::post(this->local->io_ctx, [local = this->local] {
+            local->cancelAll();
+        });
+    }
+    static std::string_view getDomain() { return "AsyncPairedIpcTransport"; }
+    using IAsyncWireTransport::asyncSend;
+    using IAsyncWireTransport::asyncRecv;
+
+    virtual void asyncSend(BufferView buffer, SendHandler handler) override
+    {
+        if (log) {
+            std::string data_str;
+            for (auto const d : buffer)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "send >>> [ {}]", data_str);
+        }
+        asio::post(this->remote->io_ctx, [remote = this->remote, buffer = Buffer{ buffer.begin(), buffer.end() }]() mutable {
+            remote->deliver(std::move(buffer));
+        });
+        asio::post(this->local->io_ctx, [handler = std::move(handler)] {
+            handler(nullptr);
+        });
+    }
+    virtual void asyncRecv(RecvHandler handler) override
+    {
+        asio::post(this->local->io_ctx, [local = this->local, handler = std::move(handler)]() mutable {
+            local->startRecv(std::move(handler));
+        });
+    }
+    virtual void cancel() override
+    {
+        asio::post(this->local->io_ctx, [local = this->local] {
+            local->cancelAll();
+        });
+    }
+    virtual uint16_t getMaxMessageSize() const override
+    {
+        return max_message_size;
+    }
+    virtual void setTimeout(std::chrono::microseconds new_timeout) override
+    {
+        this->local->timeout = new_timeout;
+    }
+
+private:
+    std::shared_ptr<AsyncIpcEndpoint> local;
+    std::shared_ptr<AsyncIpcEndpoint> remote;
+    size_t max_message_size;
+    bool log;
+};
+
+std::pair<std::unique_ptr<IAsyncWireTransport>, std::unique_ptr<IAsyncWireTransport>> makeAsyncPairedIpcTransport(asio::io_context& io_ctx, size_t max_message_size)
+{
+    auto e1 = std::make_shared<AsyncIpcEndpoint>(io_ctx);
+    auto e2 = std::make_shared<AsyncIpcEndpoint>(io_ctx);
+    return {
+        std::make_unique<AsyncPairedIpcTransport>(e1, e2, max_message_size),
+        std::make_unique<AsyncPairedIpcTransport>(e2, e1, max_message_size)
+    };
+}
+
+}
@@ -0,0 +1,495 @@
+#pragma once
+#include "Types.h"
+#include "Configuration.h"
+#include "Transports.h"
+#include "Serdes.h"
+#include "Stats.h"
+#include "TargetDetail.h"
+#include "Task.h"
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace RAP::Async {
+
+// The coroutine counterpart of RAP::RTF::RapRegisterTarget.
+// Any number of operations (up to the 256 transaction IDs) may be in flight at once;
+// responses are matched to operations by transaction_id, so they may complete in any order.
+// Coroutines are resumed on the thread running the transport's io_context.
+// Operations taking spans reference the caller's data until the returned Task completes.
+// All operations must have completed before the target is destroyed.
+template <IsConfigurationType Cfg>
+class AsyncRapRegisterTarget
+{
+public:
+    using AddressType = typename Cfg::AddressType;
+    using DataType = typename Cfg::DataType;
+public:
+    AsyncRapRegisterTarget(std::string_view name_, std::unique_ptr<RAP::Transport::IAsyncWireTransport> transport)
+        : name(name_)
+        , core(std::make_shared<Core>(std::move(transport)))
+    {
+        this->core->transport->setTimeout(this->core->timeout);
+    }
+    ~AsyncRapRegisterTarget()
+    {
+        this->core->transport->cancel();
+    }
+    AsyncRapRegisterTarget(AsyncRapRegisterTarget const&) = delete;
+    AsyncRapRegisterTarget& operator=(AsyncRapRegisterTarget const&) = delete;
+
+    std::string_view getName() const { return this->name; }
+    std::string_view getDomain() const { return "AsyncRapRegisterTarget"; }
+    // Counters and latency histograms for the operations of this target; getStats().snapshot() reads them.
+    TargetStats const& getStats() const { return this->core->stats; }
+
+    // Each operation fails with TransportTimeoutException if its response has not arrived within `timeout`.
+    void setTimeout(std::chrono::microseconds timeout)
+    {
+        {
+            std::lock_guard lg{ this->core->mtx };
+            this->core->timeout = timeout;
+        }
+        this->core->transport->setTimeout(timeout);
+    }
+
+    Task<> write(AddressType addr, DataType data)
+    {
+        auto cmd = RAP::Serdes::WriteSingleCommand<Cfg>{
+            .transaction_id = 0,
+            .posted = false,
+            .addr = addr,
+            .data = data,
+        };
+        co_await this->doCmdResp(std::move(cmd));
+    }
+    Task<DataType> read(AddressType addr)
+    {
+        auto cmd = RAP::Serdes::ReadSingleCommand<Cfg>{
+            .transaction_id = 0,
+            .addr = addr,
+        };
+        auto const resp = co_await this->doCmdResp(std::move(cmd));
+        co_return resp.data;
+    }
+    Task<> readModifyWrite(AddressType addr, DataType new_data, DataType mask)
+    {
+        if constexpr (!Cfg::FeatureReadModifyWrite) {
+            auto const old_data = co_await this->read(addr);
+            co_await this->write(addr, (old_data & ~mask) | (new_data & mask));
+        }
+        else {
+            auto cmd = RAP::Serdes::ReadModifyWriteCommand<Cfg>{
+                .transaction_id = 0,
+                .posted = false,
+                .addr = addr,
+                .data = new_data,
+                .mask = mask,
+            };
+            co_await this->doCmdResp(std::move(cmd));
+        }
+    }
+
+    // An increment the configuration cannot send as one command is done one register at a time,
+    // as IRegisterTarget::seqWrite/seqRead do for the sync target.
+    Task<> seqWrite(AddressType start_addr, std::span<DataType const> data, size_t increment = sizeof(DataType))
+    {
+        if (!RAP::RTF::detail::checkIFS<Cfg>(increment)) {
+            for (size_t i = 0; i < data.size(); i++)
+                co_await this->write(static_cast<AddressType>(start_addr + i * increment), data[i]);
+            co_return;
+        }
+        auto cmd = RAP::Serdes::WriteSeqCommand<Cfg>{
+            .transaction_id = 0,
+            .posted = false,
+            .start_addr = start_addr,
+            .increment = static_cast<typename Cfg::LengthType>(increment),
+            .data = std::vector<DataType>{ data.begin(), data.end() },
+        };
+        co_await this->doCmdResp(std::move(cmd));
+    }
+    Task<std::vector<DataType>> seqRead(AddressType start_addr, size_t count, size_t increment = sizeof(DataType))
+    {
+        if (!RAP::RTF::detail::checkIFS<Cfg>(increment)) {
+            std::vector<DataType> out_data;
+            out_data.reserve(count);
+            for (size_t i = 0; i < count; i++)
+                out_data.push_back(co_await this->read(static_cast<AddressType>(start_addr + i * increment)));
+            co_return out_data;
+        }
+        auto cmd = RAP::Serdes::ReadSeqCommand<Cfg>{
+            .transaction_id = 0,
+            .start_addr = start_addr,
+            .increment = static_cast<typename Cfg::LengthType>(increment),
+            .count = static_cast<typename Cfg::LengthType>(count),
+        };
+        auto resp = co_await this->doCmdResp(std::move(cmd));
+        co_return std::move(resp.data);
+    }
+    Task<> fifoWrite(AddressType fifo_addr, std::span<DataType const> data)
+    {
+        co_await this->seqWrite(fifo_addr, data, 0);
+    }
+    Task<std::vector<DataType>> fifoRead(AddressType fifo_addr, size_t count)
+    {
+        co_return co_await this->seqRead(fifo_addr, count, 0);
+    }
+
+    Task<> compWrite(std::span<std::pair<AddressType, DataType> const> addr_data)
+    {
+        static_assert(Cfg::FeatureCompressed, "compWrite requires FeatureCompressed");
+        auto cmd = RAP::Serdes::WriteCompCommand<Cfg>{
+            .transaction_id = 0,
+            .posted = false,
+            .addr_data = std::vector<std::pair<AddressType, DataType>>{ addr_data.begin(), addr_data.end() },
+        };
+        co_await this->doCmdResp(std::move(cmd));
+    }
+    Task<std::vector<DataType>> compRead(std::span<AddressType const> addresses)
+    {
+        static_assert(Cfg::FeatureCompressed, "compRead requires FeatureCompressed");
+        auto cmd = RAP::Serdes::ReadCompCommand<Cfg>{
+            .transaction_id = 0,
+            .addresses = std::vector<AddressType>{ addresses.begin(), addresses.end() },
+        };
+        auto resp = co_await this->doCmdResp(std::move(cmd));
+        co_return std::move(resp.data);
+    }
+
+    // Completes with the next Interrupt received from the device.
+    // Interrupts that arrive while nobody is waiting are queued.
+    Task<RAP::Serdes::Interrupt<Cfg>> nextInterrupt() requires Cfg::FeatureInterrupt
+    {
+        co_return co_await InterruptAwaitable{ *this->core };
+    }
+
+private:
+    struct Pending {
+        std::chrono::steady_clock::time_point deadline;
+        std::optional<RAP::Serdes::Response<Cfg>> response;
+        std::exception_ptr error;
+        std::coroutine_handle<> handle;
+    };
+    struct InterruptWaiter {
+        std::optional<RAP::Serdes::Interrupt<Cfg>> irq;
+        std::exception_ptr error;
+        std::coroutine_handle<> handle;
+    };
+    // State shared with transport completion handlers, which may outlive the target.
+    struct Core : std::enable_shared_from_this<Core> {
+        explicit Core(std::unique_ptr<RAP::Transport::IAsyncWireTransport> transport_)
+            : transport(std::move(transport_))
+            , serdes(this->transport->getMaxMessageSize())
+        {}
+
+        // Registers `pending` under a free transaction ID and sends the command.
+        void submit(Pending* pending, Buffer buffer, uint8_t txn_id)
+        {
+            {
+                std::lock_guard lg{ this->mtx };
+                pending->deadline = std::chrono::steady_clock::now() + this->timeout;
+                this->in_flight[txn_id] = pending;
+                this->ensureReceiving();
+            }
+            // `pending` may complete (and be destroyed) as soon as the lock is released, so only locals are used from here.
+            this->transport->asyncSend(buffer, [self = this->shared_from_this(), txn_id](std::exception_ptr error) {
+                if (error)
+                    self->complete(txn_id, std::nullopt, error);
+            });
+        }
+        uint8_t allocateTxnId()
+        {
+            std::lock_guard lg{ this->mtx };
+            // The id of an operation that timed out is only reused when no other is free: its response may still come.
+            for (bool const reuse_retired : { false, true }) {
+                for (size_t i = 0; i < this->in_flight.size(); i++) {
+                    uint8_t const id = this->next_txn_id++;
+                    if (!this->reserved[id] && (reuse_retired || !this->retired[id])) {
+                        this->reserved[id] = true;
+                        this->retired[id] = false;
+                        return id;
+                    }
+                }
+            }
+            throw Exception("AsyncRapRegisterTarget: all transaction IDs are in use");
+        }
+        void ensureReceiving()
+        {
+            // Caller holds mtx.
+            if (this->receiving)
+                return;
+            this->receiving = true;
+            this->transport->asyncRecv([self = this->shared_from_this()](std::exception_ptr error, Buffer buffer) {
+                self->onReceive(error, std::move(buffer));
+            });
+        }
+        void onReceive(std::exception_ptr error, Buffer buffer)
+        {
+            if (error) {
+                if (!isTimeout(error)) {
+                    // Cancellation or a transport failure: nothing in flight can be answered any more.
+                    this->failAll(error);
+                    return;
+                }
+            }
+            else {
+                try {
+                    auto resp = this->serdes.decodeResponse(buffer);
+                    if (auto const* irq = std::get_if<RAP::Serdes::Interrupt<Cfg>>(&resp)) {
+                        this->deliverInterrupt(*irq);
+                    }
+                    else {
+                        auto const txn_id = std::visit([](auto const& r) { return r.transaction_id; }, resp);
+                        this->complete(txn_id, std::move(resp), nullptr);
+                    }
+                }
+                catch (CrcMismatchException const&) {
+                    // A corrupt message cannot be attributed to an operation; the affected operation will time out.
+                    this->stats.recordCrcFailure();
+                }
+                catch (...) {
+                    this->stats.recordMalformed();
+                }
+            }
+            this->expire(std::chrono::steady_clock::now());
+            std::lock_guard lg{ this->mtx };
+            this->receiving = false;
+            if (this->hasWaiters())
+                this->ensureReceiving();
+        }
+        void complete(uint8_t txn_id, std::optional<RAP::Serdes::Response<Cfg>> resp, std::exception_ptr error)
+        {
+            std::unique_lock lk{ this->mtx };
+            auto* const pending = std::exchange(this->in_flight[txn_id], nullptr);
+            if (!pending) {
+                // Late response for an operation that already failed; once it is in, the id is safe to reuse.
+                if (resp) {
+                    this->stats.recordStaleResponse();
+                    this->retired[txn_id] = false;
+                }
+                return;
+            }
+            this->reserved[txn_id] = false;
+            lk.unlock();
+            pending->response = std::move(resp);
+            pending->error = error;
+            pending->handle.resume();
+        }
+        // Fail every operation whose deadline has passed with TransportTimeoutException.
+        void expire(std::chrono::steady_clock::time_point now)
+        {
+            std::vector<Pending*> expired;
+            {
+                std::lock_guard lg{ this->mtx };
+                for (size_t i = 0; i < this->in_flight.size(); i++) {
+                    if (this->in_flight[i] && this->in_flight[i]->deadline <= now) {
+                        expired.push_back(std::exchange(this->in_flight[i], nullptr));
+                        this->reserved[i] = false;
+                        this->retired[i] = true;
+                    }
+                }
+            }
+            for (auto* const pending : expired) {
+                pending->error = std::make_exception_ptr(RAP::Transport::TransportTimeoutException());
+                pending->handle.resume();
+            }
+        }
+        void failAll(std::exception_ptr error)
+        {
+            std::vector<Pending*> failed;
+            std::deque<InterruptWaiter*> failed_waiters;
+            {
+                std::lock_guard lg{ this->mtx };
+                this->receiving = false;
+                for (size_t i = 0; i < this->in_flight.size(); i++) {
+                    if (auto* const pending = std::exchange(this->in_flight[i], nullptr)) {
+                        failed.push_back(pending);
+                        this->reserved[i] = false;
+                        this->retired[i] = true;
+                    }
+                }
+                failed_waiters = std::exchange(this->interrupt_waiters, {});
+            }
+            for (auto* const pending : failed) {
+                pending->error = error;
+                pending->handle.resume();
+            }
+            for (auto* const waiter : failed_waiters) {
+                waiter->error = error;
+                waiter->handle.resume();
+            }
+        }
+        static bool isTimeout(std::exception_ptr error)
+        {
+            try {
+                std::rethrow_exception(error);
+            }
+            catch (RAP::Transport::TransportTimeoutException const&) {
+                return true;
+            }
+            catch (...) {
+                return false;
+            }
+        }
+        void deliverInterrupt(RAP::Serdes::Interrupt<Cfg> const& irq)
+        {
+            std::unique_lock lk{ this->mtx };
+            if (this->interrupt_waiters.empty()) {
+                this->interrupts.push_back(irq);
+                return;
+            }
+            auto* const waiter = this->interrupt_waiters.front();
+            this->interrupt_waiters.pop_front();
+            lk.unlock();
+            waiter->irq = irq;
+            waiter->handle.resume();
+        }
+        bool hasWaiters() const
+        {
+            // Caller holds mtx.
+            if (!this->interrupt_waiters.empty())
+                return true;
+            return std::any_of(this->in_flight.begin(), this->in_flight.end(), [](Pending* p) { return p != nullptr; });
+        }
+
+        std::unique_ptr<RAP::Transport::IAsyncWireTransport> transport;
+        RAP::Serdes::Serdes<Cfg> serdes;
+        std::mutex mtx;
+        std::chrono::microseconds timeout{ std::chrono::seconds(1) };
+        std::array<Pending*, 256> in_flight{};
+        std::array<bool, 256> reserved{};
+        // Ids of operations that ended without a response, until it arrives.
+        std::bitset<256> retired;
+        uint8_t next_txn_id = 0;
+        bool receiving = false;
+        std::deque<RAP::Serdes::Interrupt<Cfg>> interrupts;
+        std::deque<InterruptWaiter*> interrupt_waiters;
+        TargetStats stats;
+    };
+
+    class ResponseAwaitable {
+    public:
+        ResponseAwaitable(Core& core_, Buffer buffer_, uint8_t txn_id_) : core(core_), buffer(std::move(buffer_)), txn_id(txn_id_) {}
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            this->pending.handle = handle;
+            this->core.submit(&this->pending, std::move(this->buffer), this->txn_id);
+        }
+        RAP::Serdes::Response<Cfg> await_resume()
+        {
+            if (this->pending.error)
+                std::rethrow_exception(this->pending.error);
+            return std::move(*this->pending.response);
+        }
+    private:
+        Core& core;
+        Buffer buffer;
+        uint8_t txn_id;
+        Pending pending;
+    };
+
+    class InterruptAwaitable {
+    public:
+        explicit InterruptAwaitable(Core& core_) : core(core_) {}
+        bool await_ready()
+        {
+            std::lock_guard lg{ this->core.mtx };
+            if (this->core.interrupts.empty())
+                return false;
+            this->waiter.irq = this->core.interrupts.front();
+            this->core.interrupts.pop_front();
+            return true;
+        }
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            std::lock_guard lg{ this->core.mtx };
+            // An interrupt may have arrived since await_ready().
+            if (!this->core.interrupts.empty()) {
+                this->waiter.irq = this->core.interrupts.front();
+                this->core.interrupts.pop_front();
+                return false;
+            }
+            this->waiter.handle = handle;
+            this->core.interrupt_waiters.push_back(&this->waiter);
+            this->core.ensureReceiving();
+            return true;
+        }
+        RAP::Serdes::Interrupt<Cfg> await_resume()
+        {
+            if (this->waiter.error)
+                std::rethrow_exception(this->waiter.error);
+            return *this->waiter.irq;
+        }
+    private:
+        Core& core;
+        InterruptWaiter waiter;
+    };
+
+    template <typename CmdType>
+    Task<typename RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::AckResponseType> doCmdResp(CmdType cmd)
+    {
+        using AckType = typename RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::AckResponseType;
+        using NakType = typename RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::NakResponseType;
+        cmd.transaction_id = this->core->allocateTxnId();
+        Buffer buffer;
+        try {
+            buffer = this->core->serdes.encodeCommand(cmd);
+        }
+        catch (...) {
+            std::lock_guard lg{ this->core->mtx };
+            this->core->reserved[cmd.transaction_id] = false;
+            throw;
+        }
+        auto& stats = this->core->stats;
+        auto const kind = operationKindOf<Cfg>(cmd);
+        TargetStats::InFlight const in_flight{ stats };
+        auto const started = std::chrono::steady_clock::now();
+        std::optional<RAP::Serdes::Response<Cfg>> resp;
+        try {
+            resp = co_await ResponseAwaitable{ *this->core, std::move(buffer), cmd.transaction_id };
+        }
+        catch (RAP::Transport::TransportTimeoutException const&) {
+            stats.recordTimeout();
+            stats.recordError(kind);
+            throw;
+        }
+        catch (...) {
+            stats.recordError(kind);
+            throw;
+        }
+        stats.recordCompletion(kind, std::chrono::steady_clock::now() - started);
+        co_return std::visit([&](auto&& resp) -> AckType {
+            using T = std::decay_t<decltype(resp)>;
+            if constexpr (std::is_same_v<T, AckType>) {
+                return resp;
+            }
+            else if constexpr (std::is_same_v<T, NakType>) {
+                stats.recordNak(resp.status);
+                stats.recordError(kind);
+                throw OperationNakException(resp.status);
+            }
+            else {
+                stats.recordError(kind);
+                throw UnexpectedMessageTypeException();
+            }
+        }, *resp);
+    }
+
+private:
+    std::string name;
+    std::shared_ptr<Core> core;
+};
+
+}
@@ -0,0 +1,205 @@
+#include "Transports.h"
+#include "UdpMtu.h"
+#include <YALF/YALF.h>
+#include <asio.hpp>
+#include <atomic>
+#include <deque>
+#include <format>
+#include <memory>
+
+namespace RAP::Transport {
+
+class AsyncUdpTransport : public IAsyncWireTransport
+{
+private:
+    struct PendingRecv {
+        RecvHandler handler;
+        std::chrono::steady_clock::time_point deadline;
+    };
+    // Everything the io_context may still touch after the transport is destroyed lives here.
+    // All members except `timeout` are only accessed on the io_context thread.
+    struct State : std::enable_shared_from_this<State> {
+        State(asio::io_context& io_ctx_, bool log_)
+            : io_ctx(io_ctx_)
+            , socket(io_ctx_)
+            , timer(io_ctx_)
+            , max_message_size(0)
+            , timeout(std::chrono::seconds(1))
+            , log(log_)
+        {}
+        static std::string_view getDomain() { return "AsyncUdpTransport"; }
+
+        void startRecv(RecvHandler handler)
+        {
+            auto const deadline = std::chrono::steady_clock::now() + this->timeout.load();
+            this->pending.push_back(PendingRecv{ .handler = std::move(handler), .deadline = deadline });
+            if (this->pending.size() == 1)
+                this->armTimer();
+            this->startReceive();
+        }
+        void startReceive()
+        {
+            if (this->receiving || this->pending.empty())
+                return;
+            this->receiving = true;
+            this->socket.async_receive(asio::buffer(this->rx_buffer), [self = this->shared_from_this()](std::error_code const& ec, size_t recvd_bytes) {
+                self->receiving = false;
+                if (ec == asio::error::operation_aborted) {
+                    // A receive may have been started again while the cancellation was in flight.
+                    self->startReceive();
+                    return;
+                }
+                if (ec) {
+                    self->completeFront(std::make_exception_ptr(std::system_error(ec)), Buffer{});
+                }
+                else {
+                    Buffer buffer{ self->rx_buffer.begin(), self->rx_buffer.begin() + recvd_bytes };
+                    if (self->log) {
+                        std::string data_str;
+                        for (auto const d : buffer)
+                            std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+                        LOG_NOISE(self.get(), "recv <<< [ {}]", data_str);
+                    }
+                    self->completeFront(nullptr, std::move(buffer));
+                }
+                self->startReceive();
+            });
+        }
+        void completeFront(std::exception_ptr error, Buffer buffer)
+        {
+            if (this->pending.empty())
+                return;
+            auto handler = std::move(this->pending.front().handler);
+            this->pending.pop_front();
+            this->armTimer();
+            handler(error, std::move(buffer));
+        }
+        void armTimer()
+        {
+            if (this->pending.empty()) {
+                this->timer.cancel();
+                return;
+            }
+            this->timer.expires_at(this->pending.front().deadline);
+            this->timer.async_wait([self = this->shared_from_this()](std::error_code const& ec) {
+                if (ec == asio::error::operation_aborted)
+                    return;
+                self->expire();
+            });
+        }
+        void expire()
+        {
+            auto const now = std::chrono::steady_clock::now();
+            while (!this->pending.empty() && this->pending.front().deadline <= now) {
+                auto handler = std::move(this->pending.front().handler);
+                this->pending.pop_front();
+                handler(std::make_exception_ptr(TransportTimeoutException()), Buffer{});
+            }
+            if (this->pending.empty()) {
+                // Nobody is waiting; leave further datagrams in the socket buffer.
+                this->socket.cancel();
+            }
+            this->armTimer();
+        }
+        void cancelAll()
+        {
+            this->socket.cancel();
+            this->timer.cancel();
+            auto pending_ = std::exchange(this->pending, {});
+            for (auto& p : pending_)
+                p.handler(std::make_exception_ptr(TransportCancelledException()), Buffer{});
+        }
+
+        asio::io_context& io_ctx;
+        asio::ip::udp::socket socket;
+        asio::steady_timer timer;
+        size_t max_message_size;
+        Buffer rx_buffer;
+        std::deque<PendingRecv> pending;
+        bool receiving = false;
+        std::atomic<std::chrono::microseconds> timeout;
+        bool log;
+    };
+
+public:
+    AsyncUdpTransport(asio::io_context& io_ctx, std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options)
+        : state(std::make_shared<State>(io_ctx, options.log))
+    {
+        auto const local_ep = this->resolveEndpoint(local_host, local_port);
+        this->state->socket.open(local_ep.protocol());
+        this->state->socket.bind(local_ep);
+        this->state->socket.connect(this->resolveEndpoint(remote_host, remote_port));
+        // Sized from the connected socket, before the io_context can touch the state.
+        this->state->max_message_size = detail::udpMaxMessageSize(this->state->socket, options);
+        this->state->rx_buffer.resize(this->state->max_message_size);
+    }
+    ~AsyncUdpTransport()
+    {
+        asio::post(this->state->io_ctx, [state = this->state] {
+            state->cancelAll();
+            state->socket.close();
+        });
+    }
+    static std::string_view getDomain() { return "AsyncUdpTransport"; }
+    using IAsyncWireTransport::asyncSend;
+    using IAsyncWireTransport::asyncRecv;
+
+    virtual void asyncSend(BufferView buffer, SendHandler handler) override
+    {
+        if (this->state->log) {
+            std::string data_str;
+            for (auto const d : buffer)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "send >>> [ {}]", data_str);
+        }
+        auto owned = std::make_shared<Buffer>(buffer.begin(), buffer.end());
+        asio::post(this->state->io_ctx, [state = this->state, owned = std::move(owned), handler = std::move(handler)]() mutable {
+            auto const asio_buf = asio::buffer(*owned);
+            state->socket.async_send(asio_buf, [owned = std::move(owned), handler = std::move(handler)](std::error_code const& ec, size_t) {
+                handler(ec ? std::make_exception_ptr(std::system_error(ec)) : nullptr);
+            });
+        });
+    }
+    virtual void asyncRecv(RecvHandler handler) override
+    {
+        asio::post(this->state->io_ctx, [state = this->state, handler = std::move(handler)]() mutable {
+            state->startRecv(std::move(handler));
+        });
+    }
+    virtual void cancel() override
+    {
+        asio::post(this->state->io_ctx, [state = this->state] {
+            state->cancelAll();
+        });
+    }
+    virtual uint16_t getMaxMessageSize() const override
+    {
+        return this->state->max_message_size;
+    }
+    virtual void setTimeout(std::chrono::microseconds new_timeout) override
+    {
+        this->state->timeout = new_timeout;
+    }
+
+private:
+    asio::ip::udp::endpoint resolveEndpoint(std::string_view host, uint16_t port)
+    {
+        asio::ip::udp::resolver resolver{ this->state->io_ctx };
+        auto const endpoints = resolver.resolve(host, std::format("{}", port));
+        return *endpoints.begin();
+    }
+
+private:
+    std::shared_ptr<State> state;
+};
+
+std::unique_ptr<IAsyncWireTransport> makeAsyncUdpTransport(asio::io_context& io_ctx, std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, bool log)
+{
+    return makeAsyncUdpTransport(io_ctx, remote_host, remote_port, local_host, local_port, UdpTransportOptions{ .log = log });
+}
+std::unique_ptr<IAsyncWireTransport> makeAsyncUdpTransport(asio::io_context& io_ctx, std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options)
+{
+    return std::make_unique<AsyncUdpTransport>(io_ctx, remote_host, remote_port, local_host, local_port, options);
+}
+
+}
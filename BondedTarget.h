@@ -0,0 +1,221 @@
+#pragma once
+#include "Configuration.h"
+#include "RegisterTarget.h"
+#include "Serdes.h"
+#include "TargetDetail.h"
+#include "Transports.h"
+#include "Types.h"
+#include <RTF/RTF.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace RAP::RTF {
+
+struct BondOptions {
+    // Registers per stripe of a seqRead/seqWrite; 0 means as many as fit in one message on the smallest link.
+    size_t stripe_registers = 0;
+    // Batches with fewer registers than this run on a single link, from the calling thread.
+    size_t parallel_threshold = 256;
+};
+
+// Spreads operations over several links (transports) to the same register space, e.g. one per NIC.
+// Each link is a RapRegisterTarget.  Large sequential transfers are cut into stripes that the links take in turn,
+// as each becomes free, so faster links carry more of them.  Everything else touching a register goes over the link
+// chosen by its address: single-register and FIFO operations use it, and compressed batches are split per link with
+// their order kept.  Operations on the same address are therefore always issued in order, on one link.
+template <IsConfigurationType Cfg>
+class BondedRegisterTarget : public ::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>
+{
+public:
+    using AddressType = typename Cfg::AddressType;
+    using DataType = typename Cfg::DataType;
+public:
+    BondedRegisterTarget(std::string_view name, std::vector<std::unique_ptr<RAP::Transport::ISyncWireTransport>> transports, BondOptions options_ = {})
+        : ::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>(name)
+        , options(options_)
+    {
+        if (transports.empty())
+            throw Exception("BondedRegisterTarget needs at least one transport");
+        auto max_message_size = transports.front()->getMaxMessageSize();
+        for (auto& transport : transports) {
+            max_message_size = std::min(max_message_size, transport->getMaxMessageSize());
+            this->links.push_back(std::make_unique<Link>(name, std::move(transport)));
+        }
+        RAP::Serdes::Serdes<Cfg> const serdes(max_message_size);
+        this->seq_read_stripe = this->options.stripe_registers != 0 ? this->options.stripe_registers : serdes.getMaxSeqReadCount();
+        this->seq_write_stripe = this->options.stripe_registers != 0 ? this->options.stripe_registers : serdes.getMaxSeqWriteCount();
+        if (this->seq_read_stripe == 0 || this->seq_write_stripe == 0)
+            throw MessageSizeException("The smallest link's max message size leaves no room for a sequential transfer");
+    }
+    virtual std::string_view getDomain() const { return "BondedRegisterTarget"; }
+
+    // The link's own target, e.g. for interrupt handlers.  Operations on it are not serialized with the bond's.
+    RapRegisterTarget<Cfg>& getLink(size_t index) { return this->links.at(index)->target; }
+    size_t getLinkCount() const { return this->links.size(); }
+
+    virtual void write(AddressType addr, DataType data) override
+    {
+        auto& link = this->linkFor(addr);
+        std::lock_guard lg{ link.mtx };
+        link.target.write(addr, data);
+    }
+    [[nodiscard]] virtual DataType read(AddressType addr) override
+    {
+        auto& link = this->linkFor(addr);
+        std::lock_guard lg{ link.mtx };
+        return link.target.read(addr);
+    }
+    virtual void readModifyWrite(AddressType addr, DataType new_data, DataType mask) override
+    {
+        auto& link = this->linkFor(addr);
+        std::lock_guard lg{ link.mtx };
+        link.target.readModifyWrite(addr, new_data, mask);
+    }
+
+    virtual void seqWrite(AddressType start_addr, std::span<DataType const> data, size_t increment = sizeof(DataType)) override
+    {
+        if (increment == 0)
+            return this->fifoWrite(start_addr, data);
+        this->stripe(start_addr, data.size(), this->seq_write_stripe, [&](RapRegisterTarget<Cfg>& target, size_t first, size_t count) {
+            target.seqWrite(static_cast<AddressType>(start_addr + first * increment), data.subspan(first, count), increment);
+        });
+    }
+    virtual void seqRead(AddressType start_addr, std::span<DataType> out_data, size_t increment = sizeof(DataType)) override
+    {
+        if (increment == 0)
+            return this->fifoRead(start_addr, out_data);
+        this->stripe(start_addr, out_data.size(), this->seq_read_stripe, [&](RapRegisterTarget<Cfg>& target, size_t first, size_t count) {
+            target.seqRead(static_cast<AddressType>(start_addr + first * increment), out_data.subspan(first, count), increment);
+        });
+    }
+
+    // FIFO contents depend on the order of the accesses, so a FIFO is only ever accessed over its own link.
+    virtual void fifoWrite(AddressType fifo_addr, std::span<DataType const> data) override
+    {
+        auto& link = this->linkFor(fifo_addr);
+        std::lock_guard lg{ link.mtx };
+        link.target.fifoWrite(fifo_addr, data);
+    }
+    virtual void fifoRead(AddressType fifo_addr, std::span<DataType> out_data) override
+    {
+        auto& link = this->linkFor(fifo_addr);
+        std::lock_guard lg{ link.mtx };
+        link.target.fifoRead(fifo_addr, out_data);
+    }
+
+    virtual void compWrite(std::span<std::pair<AddressType, DataType> const> addr_data) override
+    {
+        std::vector<CompBatch> batches(this->links.size());
+        for (auto const& ad : addr_data)
+            batches[this->linkIndexFor(ad.first)].addr_data.push_back(ad);
+        this->runBatches(batches, addr_data.size(), [](Link& link, CompBatch& b) {
+            link.target.compWrite(b.addr_data);
+        });
+    }
+    virtual void compRead(std::span<AddressType const> const addresses, std::span<DataType> out_data) override
+    {
+        assert(addresses.size() == out_data.size());
+        std::vector<CompBatch> batches(this->links.size());
+        for (size_t i = 0; i < addresses.size(); i++) {
+            auto& b = batches[this->linkIndexFor(addresses[i])];
+            b.addresses.push_back(addresses[i]);
+            b.positions.push_back(i);
+        }
+        this->runBatches(batches, addresses.size(), [&](Link& link, CompBatch& b) {
+            std::vector<DataType> data(b.addresses.size());
+            link.target.compRead(b.addresses, data);
+            for (size_t i = 0; i < data.size(); i++)
+                out_data[b.positions[i]] = data[i];
+        });
+    }
+
+private:
+    struct Link {
+        Link(std::string_view name, std::unique_ptr<RAP::Transport::ISyncWireTransport> transport)
+            : target(name, std::move(transport))
+        {}
+        // A RapRegisterTarget runs one operation at a time.
+        std::mutex mtx;
+        RapRegisterTarget<Cfg> target;
+    };
+    struct CompBatch {
+        std::vector<AddressType> addresses;
+        std::vector<size_t> positions;
+        std::vector<std::pair<AddressType, DataType>> addr_data;
+    };
+
+    size_t linkIndexFor(AddressType addr) const
+    {
+        return (addr / sizeof(DataType)) % this->links.size();
+    }
+    Link& linkFor(AddressType addr)
+    {
+        return *this->links[this->linkIndexFor(addr)];
+    }
+    // Calls fn(target, first, count) for each stripe of `stripe_size` registers out of `total`.
+    // Small transfers run in order on the link of `start_addr`; larger ones are pulled stripe by stripe by
+    // one task per link.
+    template <typename Fn>
+    void stripe(AddressType start_addr, size_t total, size_t stripe_size, Fn&& fn)
+    {
+        auto const stripes = (total + stripe_size - 1) / stripe_size;
+        if (stripes <= 1 || this->links.size() == 1 || total < this->options.parallel_threshold) {
+            auto& link = this->linkFor(start_addr);
+            std::lock_guard lg{ link.mtx };
+            fn(link.target, 0, total);
+            return;
+        }
+        std::atomic<size_t> next_stripe{ 0 };
+        std::atomic<bool> failed{ false };
+        detail::runParallel(std::min(stripes, this->links.size()), [&](size_t index) {
+            auto& link = *this->links[index];
+            while (!failed) {
+                auto const s = next_stripe.fetch_add(1);
+                if (s >= stripes)
+                    return;
+                auto const first = s * stripe_size;
+                std::lock_guard lg{ link.mtx };
+                try {
+                    fn(link.target, first, std::min(stripe_size, total - first));
+                }
+                catch (...) {
+                    // The other links stop taking stripes.
+                    failed = true;
+                    throw;
+                }
+            }
+        });
+    }
+    // Runs fn(link, batch) for each non-empty batch on the link of the same index.
+    template <typename Fn>
+    void runBatches(std::vector<CompBatch>& batches, size_t total, Fn&& fn)
+    {
+        std::vector<size_t> used;
+        for (size_t i = 0; i < batches.size(); i++) {
+            if (!batches[i].addresses.empty() || !batches[i].addr_data.empty())
+                used.push_back(i);
+        }
+        auto const run = [&](size_t u) {
+            auto& link = *this->links[used[u]];
+            std::lock_guard lg{ link.mtx };
+            fn(link, batches[used[u]]);
+        };
+        if (used.size() <= 1 || total < this->options.parallel_threshold) {
+            for (size_t u = 0; u < used.size(); u++)
+                run(u);
+            return;
+        }
+        detail::runParallel(used.size(), run);
+    }
+private:
+    BondOptions options;
+    std::vector<std::unique_ptr<Link>> links;
+    size_t seq_read_stripe = 0;
+    size_t seq_write_stripe = 0;
+};
+
+}
@@ -0,0 +1,207 @@
+#pragma once
+#include "Types.h"
+#include "Configuration.h"
+#include "Transports.h"
+#include "Serdes.h"
+#include "TargetDetail.h"
+#include <RTF/RTF.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace RAP::RTF {
+
+struct BroadcastOptions {
+    // Send writes as posted commands: nobody acknowledges them, so an operation costs one datagram and no waiting,
+    // but failures go unnoticed.
+    bool posted = false;
+};
+
+// Writes the same registers on every member of a group of identical devices with one datagram per command,
+// e.g. to configure a rack of boards at once.  Reads are not supported; use each device's own target for those.
+// Non-posted writes wait until every member has acknowledged them, or until no reply has arrived for the
+// transport's timeout, and throw BroadcastWriteException unless all members sent an ACK.
+template <IsConfigurationType Cfg>
+class BroadcastRegisterTarget : public ::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>
+{
+public:
+    using AddressType = typename Cfg::AddressType;
+    using DataType = typename Cfg::DataType;
+public:
+    BroadcastRegisterTarget(std::string_view name, std::unique_ptr<RAP::Transport::ISyncGroupTransport> transport_, BroadcastOptions options_ = {})
+        : ::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>(name)
+        , transport(std::move(transport_))
+        , serdes(this->transport->getMaxMessageSize())
+        , options(options_)
+        , tx_buffer()
+        , rx_buffer(this->transport->getMaxMessageSize())
+        , acked(this->transport->getMemberCount())
+    {}
+    virtual std::string_view getDomain() const { return "BroadcastRegisterTarget"; }
+
+    virtual void write(AddressType addr, DataType data) override
+    {
+        this->broadcast(RAP::Serdes::WriteSingleCommand<Cfg>{
+            .transaction_id = this->getNextTxnId(),
+            .posted = this->options.posted,
+            .addr = addr,
+            .data = data,
+        });
+    }
+    [[nodiscard]] virtual DataType read(AddressType) override
+    {
+        throw Exception("BroadcastRegisterTarget cannot read");
+    }
+    virtual void readModifyWrite(AddressType addr, DataType new_data, DataType mask) override
+    {
+        if (!Cfg::FeatureReadModifyWrite)
+            throw Exception("BroadcastRegisterTarget cannot emulate readModifyWrite without Cfg::FeatureReadModifyWrite");
+        this->broadcast(RAP::Serdes::ReadModifyWriteCommand<Cfg>{
+            .transaction_id = this->getNextTxnId(),
+            .posted = this->options.posted,
+            .addr = addr,
+            .data = new_data,
+            .mask = mask,
+        });
+    }
+
+    virtual void seqWrite(AddressType start_addr, std::span<DataType const> data, size_t increment = sizeof(DataType)) override
+    {
+        if (!detail::checkIFS<Cfg>(increment))
+            return this->IRegisterTarget::seqWrite(start_addr, data, increment);
+        detail::forEachChunk(data.size(), this->serdes.getMaxSeqWriteCount(), [&](size_t offset, size_t count) {
+            this->broadcast(RAP::Serdes::WriteSeqCommand<Cfg>{
+                .transaction_id = this->getNextTxnId(),
+                .posted = this->options.posted,
+                .start_addr = static_cast<AddressType>(start_addr + offset * increment),
+                .increment = static_cast<Cfg::LengthType>(increment),
+                .data = std::vector<DataType>{ data.begin() + offset, data.begin() + offset + count },
+            });
+        });
+    }
+    virtual void seqRead(AddressType, std::span<DataType>, size_t = sizeof(DataType)) override
+    {
+        throw Exception("BroadcastRegisterTarget cannot read");
+    }
+
+    virtual void fifoWrite(AddressType fifo_addr, std::span<DataType const> data) override
+    {
+        if (!Cfg::FeatureFifo)
+            return this->IRegisterTarget::fifoWrite(fifo_addr, data);
+        detail::forEachChunk(data.size(), this->serdes.getMaxSeqWriteCount(), [&](size_t offset, size_t count) {
+            this->broadcast(RAP::Serdes::WriteSeqCommand<Cfg>{
+                .transaction_id = this->getNextTxnId(),
+                .posted = this->options.posted,
+                .start_addr = fifo_addr,
+                .increment = 0,
+                .data = std::vector<DataType>{ data.begin() + offset, data.begin() + offset + count },
+            });
+        });
+    }
+    virtual void fifoRead(AddressType, std::span<DataType>) override
+    {
+        throw Exception("BroadcastRegisterTarget cannot read");
+    }
+
+    virtual void compWrite(std::span<std::pair<AddressType, DataType> const> addr_data) override
+    {
+        if (!Cfg::FeatureCompressed)
+            return this->IRegisterTarget::compWrite(addr_data);
+        detail::forEachChunk(addr_data.size(), this->serdes.getMaxCompWriteCount(), [&](size_t offset, size_t count) {
+            this->broadcast(RAP::Serdes::WriteCompCommand<Cfg>{
+                .transaction_id = this->getNextTxnId(),
+                .posted = this->options.posted,
+                .addr_data = std::vector<std::pair<AddressType, DataType>>{ addr_data.begin() + offset, addr_data.begin() + offset + count },
+            });
+        });
+    }
+    virtual void compRead(std::span<AddressType const> const, std::span<DataType>) override
+    {
+        throw Exception("BroadcastRegisterTarget cannot read");
+    }
+
+private:
+    enum class ReplyKind { eIgnore, eAck, eNak };
+    template <typename CmdType>
+    void broadcast(CmdType const& cmd)
+    {
+        this->serdes.encodeCommand(cmd, this->tx_buffer);
+        this->transport->send(this->tx_buffer);
+        if (cmd.posted)
+            return;
+
+        // Collect one reply per member.  Replies to earlier transactions (late ones, after a timeout),
+        // interrupts and duplicates are skipped.
+        using AckType = typename RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::AckResponseType;
+        using NakType = typename RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::NakResponseType;
+        std::fill(this->acked.begin(), this->acked.end(), false);
+        std::vector<std::pair<size_t, uint32_t>> naks;
+        size_t outstanding = this->acked.size();
+        while (outstanding > 0) {
+            size_t member = 0;
+            size_t resp_size = 0;
+            try {
+                resp_size = this->transport->recv(this->rx_buffer, member);
+            }
+            catch (RAP::Transport::TransportTimeoutException const&) {
+                break;
+            }
+            RAP::Serdes::Response<Cfg> resp;
+            try {
+                resp = this->serdes.decodeResponse(BufferView{ this->rx_buffer }.first(resp_size));
+            }
+            catch (Exception const&) {
+                // A corrupted reply; unless the member sends another, it is reported as missing.
+                continue;
+            }
+            uint32_t nak_status = 0;
+            auto const kind = std::visit([&](auto const& resp) {
+                using T = std::decay_t<decltype(resp)>;
+                if constexpr (std::is_same_v<T, RAP::Serdes::Interrupt<Cfg>>) {
+                    return ReplyKind::eIgnore;
+                }
+                else {
+                    if (resp.transaction_id != cmd.transaction_id)
+                        return ReplyKind::eIgnore;
+                    if constexpr (std::is_same_v<T, AckType>) {
+                        return ReplyKind::eAck;
+                    }
+                    else {
+                        if constexpr (std::is_same_v<T, NakType>)
+                            nak_status = resp.status;
+                        return ReplyKind::eNak;
+                    }
+                }
+            }, resp);
+            if (kind == ReplyKind::eIgnore || this->acked[member])
+                continue;
+            this->acked[member] = true;
+            outstanding--;
+            if (kind == ReplyKind::eNak)
+                naks.emplace_back(member, nak_status);
+        }
+        if (outstanding == 0 && naks.empty())
+            return;
+        std::vector<size_t> missing;
+        for (size_t i = 0; i < this->acked.size(); i++) {
+            if (!this->acked[i])
+                missing.push_back(i);
+        }
+        throw BroadcastWriteException(std::move(missing), std::move(naks));
+    }
+    uint8_t getNextTxnId()
+    {
+        return this->next_txn_id.fetch_add(1);
+    }
+private:
+    std::unique_ptr<RAP::Transport::ISyncGroupTransport> transport;
+    RAP::Serdes::Serdes<Cfg> serdes;
+    BroadcastOptions options;
+    Buffer tx_buffer;
+    Buffer rx_buffer;
+    std::vector<bool> acked;
+    std::atomic<uint8_t> next_txn_id;
+};
+
+}
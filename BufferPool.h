@@ -0,0 +1,141 @@
+#pragma once
+#include "Types.h"
+#include <algorithm>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace RAP {
+
+class BufferPool;
+
+// A Buffer leased from a BufferPool; it is returned to the pool when the lease is destroyed.
+// The pool must outlive all of its leases.
+class PooledBuffer
+{
+public:
+    PooledBuffer() = default;
+    PooledBuffer(PooledBuffer&& other) noexcept
+        : pool(std::exchange(other.pool, nullptr))
+        , buffer(std::move(other.buffer))
+    {}
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept
+    {
+        if (this != &other) {
+            this->release();
+            this->pool = std::exchange(other.pool, nullptr);
+            this->buffer = std::move(other.buffer);
+        }
+        return *this;
+    }
+    ~PooledBuffer() { this->release(); }
+
+    Buffer& operator*() { return this->buffer; }
+    Buffer const& operator*() const { return this->buffer; }
+    Buffer* operator->() { return &this->buffer; }
+    Buffer const* operator->() const { return &this->buffer; }
+
+private:
+    friend class BufferPool;
+    PooledBuffer(BufferPool* pool_, Buffer buffer_) : pool(pool_), buffer(std::move(buffer_)) {}
+    void release();
+
+    BufferPool* pool = nullptr;
+    Buffer buffer;
+};
+
+// A free list of Buffers with capacity for one message each.
+// Once the pool holds as many buffers as are in use at the same time, leasing and returning
+// buffers no longer touches the heap.  Thread-safe.
+class BufferPool
+{
+public:
+    explicit BufferPool(size_t buffer_size_, size_t initial_count = 0)
+        : buffer_size(buffer_size_)
+    {
+        this->free.reserve(initial_count);
+        for (size_t i = 0; i < initial_count; i++)
+            this->free.push_back(this->makeBuffer());
+    }
+    BufferPool(BufferPool const&) = delete;
+    BufferPool& operator=(BufferPool const&) = delete;
+
+    // The leased buffer is empty, with capacity for at least getBufferSize() bytes.
+    PooledBuffer lease()
+    {
+        {
+            std::lock_guard lg{ this->mtx };
+            if (!this->free.empty()) {
+                auto buffer = std::move(this->free.back());
+                this->free.pop_back();
+                return PooledBuffer{ this, std::move(buffer) };
+            }
+        }
+        return PooledBuffer{ this, this->makeBuffer() };
+    }
+    size_t getBufferSize() const { return this->buffer_size; }
+
+private:
+    friend class PooledBuffer;
+    Buffer makeBuffer() const
+    {
+        Buffer buffer;
+        buffer.reserve(this->buffer_size);
+        return buffer;
+    }
+    void giveBack(Buffer buffer)
+    {
+        buffer.clear();
+        std::lock_guard lg{ this->mtx };
+        this->free.push_back(std::move(buffer));
+    }
+
+    size_t buffer_size;
+    std::mutex mtx;
+    std::vector<Buffer> free;
+};
+
+inline void PooledBuffer::release()
+{
+    if (this->pool)
+        std::exchange(this->pool, nullptr)->giveBack(std::move(this->buffer));
+}
+
+// A FIFO of pooled buffers backed by a ring that only grows, so steady-state push/pop does not allocate.
+// Not thread-safe; callers provide their own locking.
+class PooledBufferQueue
+{
+public:
+    bool empty() const { return this->count == 0; }
+    size_t size() const { return this->count; }
+    void push(PooledBuffer buffer)
+    {
+        if (this->count == this->ring.size())
+            this->grow();
+        this->ring[(this->head + this->count) % this->ring.size()] = std::move(buffer);
+        this->count++;
+    }
+    PooledBuffer pop()
+    {
+        auto buffer = std::move(this->ring[this->head]);
+        this->head = (this->head + 1) % this->ring.size();
+        this->count--;
+        return buffer;
+    }
+
+private:
+    void grow()
+    {
+        std::vector<PooledBuffer> bigger(std::max<size_t>(16, this->ring.size() * 2));
+        for (size_t i = 0; i < this->count; i++)
+            bigger[i] = std::move(this->ring[(this->head + i) % this->ring.size()]);
+        this->ring = std::move(bigger);
+        this->head = 0;
+    }
+
+    std::vector<PooledBuffer> ring;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+}
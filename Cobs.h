@@ -0,0 +1,108 @@
+#pragma once
+#include "Types.h"
+#include <functional>
+
+// Consistent Overhead Byte Stuffing, for carrying messages over byte streams such as UARTs.
+// An encoded frame contains no 0x00 bytes, so 0x00 delimits frames; the overhead is one byte per 254.
+namespace RAP::Cobs {
+
+// Worst-case encoded size of a message, including the leading and trailing delimiters.
+constexpr size_t maxFrameSize(size_t message_size)
+{
+    return message_size + message_size / 254 + 1 + 2;
+}
+
+// Appends `message` to `out` as a frame surrounded by 0x00 delimiters.
+// The leading delimiter terminates any line noise received since the previous frame.
+inline void encode(BufferView message, Buffer& out)
+{
+    out.push_back(0x00);
+    size_t code_pos = out.size();
+    out.push_back(0);
+    uint8_t code = 1;
+    for (auto const b : message) {
+        if (b != 0) {
+            out.push_back(b);
+            code++;
+        }
+        if (b == 0 || code == 0xFF) {
+            out[code_pos] = code;
+            code_pos = out.size();
+            out.push_back(0);
+            code = 1;
+        }
+    }
+    out[code_pos] = code;
+    out.push_back(0x00);
+}
+
+// Decodes one frame (without delimiters) into `out`, replacing its contents.  Returns false if it is malformed.
+inline bool decode(BufferView frame, Buffer& out)
+{
+    out.clear();
+    size_t i = 0;
+    while (i < frame.size()) {
+        uint8_t const code = frame[i++];
+        if (code == 0 || i + code - 1 > frame.size())
+            return false;
+        out.insert(out.end(), frame.begin() + i, frame.begin() + i + code - 1);
+        i += code - 1;
+        if (code != 0xFF && i < frame.size())
+            out.push_back(0);
+    }
+    return true;
+}
+
+// Incrementally splits a byte stream into messages.
+// Bytes may be fed in arbitrary chunks.  Frames that are too long, malformed, or rejected by the
+// validator are dropped and the deframer resynchronizes on the next delimiter.
+class Deframer
+{
+public:
+    using Validator = std::function<bool(BufferView)>;
+
+    explicit Deframer(size_t max_message_size_, Validator validator_ = {})
+        : max_frame_size(maxFrameSize(max_message_size_))
+        , validator(std::move(validator_))
+    {
+        this->frame.reserve(this->max_frame_size);
+        this->decoded.reserve(max_message_size_);
+    }
+
+    // Calls on_message(BufferView) for each complete, valid message in `data`.
+    // The view is only valid during the call.
+    template <typename OnMessage>
+    void feed(BufferView data, OnMessage&& on_message)
+    {
+        for (auto const b : data) {
+            if (b != 0x00) {
+                if (this->frame.size() < this->max_frame_size)
+                    this->frame.push_back(b);
+                else
+                    this->overflowed = true;
+                continue;
+            }
+            if (!this->frame.empty() && !this->overflowed && decode(this->frame, this->decoded)
+                && (!this->validator || this->validator(this->decoded))) {
+                on_message(BufferView{ this->decoded });
+            }
+            else if (!this->frame.empty()) {
+                this->dropped_frames++;
+            }
+            this->frame.clear();
+            this->overflowed = false;
+        }
+    }
+    // Number of frames discarded as garbage so far.
+    size_t getDroppedFrames() const { return this->dropped_frames; }
+
+private:
+    size_t max_frame_size;
+    Validator validator;
+    Buffer frame;
+    Buffer decoded;
+    bool overflowed = false;
+    size_t dropped_frames = 0;
+};
+
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include "Types.h"
+#include "Configuration.h"
+#include "Transports.h"
+#include "AsyncRegisterTarget.h"
+#include "Task.h"
+#include <asio.hpp>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace RAP::Async {
+
+struct DeviceManagerOptions {
+    // Each reactor thread runs its own io_context (an epoll loop on Linux) and owns the sockets of its devices.
+    size_t reactor_threads = 1;
+    // If not empty, reactor i is pinned to reactor_cpus[i] (Linux only); needs one entry per reactor.
+    std::vector<unsigned> reactor_cpus;
+};
+
+// Runs many devices on a few threads: every device is an AsyncRapRegisterTarget whose transport is serviced by one
+// of the manager's reactors, assigned round-robin, so a thousand devices cost a thousand sockets but only
+// `reactor_threads` threads.  The transactions of all devices on a reactor are multiplexed by its event loop.
+// A device's coroutines are resumed on its reactor's thread; use spawn() to start work there, or syncWait() on the
+// device's Tasks from any other thread.
+template <IsConfigurationType Cfg>
+class DeviceManager
+{
+public:
+    using Device = AsyncRapRegisterTarget<Cfg>;
+    using TransportFactory = std::function<std::unique_ptr<RAP::Transport::IAsyncWireTransport>(asio::io_context&)>;
+public:
+    explicit DeviceManager(DeviceManagerOptions const& options = {})
+    {
+        if (options.reactor_threads == 0)
+            throw Exception("DeviceManager needs at least one reactor thread");
+        if (!options.reactor_cpus.empty() && options.reactor_cpus.size() != options.reactor_threads)
+            throw Exception("DeviceManagerOptions::reactor_cpus needs one entry per reactor thread");
+        for (size_t i = 0; i < options.reactor_threads; i++)
+            this->reactors.push_back(std::make_unique<Reactor>());
+        for (size_t i = 0; i < options.reactor_threads; i++) {
+            std::optional<unsigned> cpu;
+            if (!options.reactor_cpus.empty())
+                cpu = options.reactor_cpus[i];
+            this->reactors[i]->thread = std::jthread([reactor = this->reactors[i].get(), cpu] {
+                if (cpu)
+                    RAP::Transport::pinCurrentThreadToCpu(*cpu);
+                reactor->io_ctx.run();
+            });
+        }
+    }
+    // Destroys the remaining devices, whose operations must all have completed, then stops the reactors.
+    ~DeviceManager()
+    {
+        this->devices.clear();
+        this->device_index.clear();
+        // The reactors finish the cleanup the transports posted before they return.
+        for (auto& reactor : this->reactors)
+            reactor->work.reset();
+        for (auto& reactor : this->reactors) {
+            if (reactor->thread.joinable())
+                reactor->thread.join();
+        }
+    }
+    DeviceManager(DeviceManager const&) = delete;
+    DeviceManager& operator=(DeviceManager const&) = delete;
+
+    static std::string_view getDomain() { return "DeviceManager"; }
+
+    // Adds a device reached over UDP.  The returned handle stays valid until removeDevice() or destruction.
+    Device& addUdpDevice(std::string_view name, std::string_view remote_host, uint16_t remote_port, std::string_view local_host = "", uint16_t local_port = 0, RAP::Transport::UdpTransportOptions const& options = {})
+    {
+        return this->addDevice(name, [&](asio::io_context& io_ctx) {
+            return RAP::Transport::makeAsyncUdpTransport(io_ctx, remote_host, remote_port, local_host, local_port, options);
+        });
+    }
+    // Adds a device over any async transport, which `make_transport` creates on the io_context of the chosen reactor.
+    Device& addDevice(std::string_view name, TransportFactory const& make_transport)
+    {
+        std::lock_guard lg{ this->mtx };
+        auto const reactor = this->next_reactor;
+        auto entry = std::make_unique<Entry>(name, make_transport(this->reactors[reactor]->io_ctx), reactor);
+        auto& device = entry->device;
+        this->device_index.emplace(&device, this->devices.size());
+        this->devices.push_back(std::move(entry));
+        this->next_reactor = (reactor + 1) % this->reactors.size();
+        return device;
+    }
+    // All of the device's operations must have completed.
+    void removeDevice(Device& device)
+    {
+        std::lock_guard lg{ this->mtx };
+        auto const it = this->device_index.find(&device);
+        if (it == this->device_index.end())
+            throw Exception("DeviceManager::removeDevice: unknown device");
+        auto const index = it->second;
+        this->device_index.erase(it);
+        // Move the last device into the gap.
+        if (index != this->devices.size() - 1) {
+            this->devices[index] = std::move(this->devices.back());
+            this->device_index[&this->devices[index]->device] = index;
+        }
+        this->devices.pop_back();
+    }
+
+    size_t getDeviceCount() const
+    {
+        std::lock_guard lg{ this->mtx };
+        return this->devices.size();
+    }
+    // Indices change when a device is removed.
+    Device& getDevice(size_t index)
+    {
+        std::lock_guard lg{ this->mtx };
+        return this->devices.at(index)->device;
+    }
+    size_t getReactorCount() const { return this->reactors.size(); }
+    asio::io_context& getReactor(Device const& device)
+    {
+        std::lock_guard lg{ this->mtx };
+        return this->reactors[this->devices[this->device_index.at(&device)]->reactor]->io_ctx;
+    }
+
+    // Starts `task` on the reactor thread of `device`, so that it runs on that thread only.
+    void spawn(Device const& device, Task<void> task, std::function<void(std::exception_ptr)> on_error = {})
+    {
+        asio::post(this->getReactor(device), [task = std::move(task), on_error = std::move(on_error)]() mutable {
+            RAP::Async::spawn(std::move(task), std::move(on_error));
+        });
+    }
+
+private:
+    struct Reactor {
+        asio::io_context io_ctx{ 1 };
+        std::optional<asio::executor_work_guard<asio::io_context::executor_type>> work{ asio::make_work_guard(io_ctx) };
+        std::jthread thread;
+    };
+    struct Entry {
+        Entry(std::string_view name, std::unique_ptr<RAP::Transport::IAsyncWireTransport> transport, size_t reactor_)
+            : device(name, std::move(transport))
+            , reactor(reactor_)
+        {}
+        Device device;
+        size_t reactor;
+    };
+
+private:
+    mutable std::mutex mtx;
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    std::vector<std::unique_ptr<Entry>> devices;
+    std::unordered_map<Device const*, size_t> device_index;
+    size_t next_reactor = 0;
+};
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "Transports.h"
+#include <cerrno>
+#include <chrono>
+#include <stop_token>
+#include <system_error>
+#include <poll.h>
+#include <unistd.h>
+
+// Helpers shared by the transports built directly on POSIX file descriptors.
+namespace RAP::Transport::detail {
+
+[[noreturn]] inline void throwErrno(char const* what)
+{
+    throw std::system_error(errno, std::system_category(), what);
+}
+
+// Waits until `fd` reports one of `events` (POLLIN/POLLOUT).  Returns false if `stoken` was signalled;
+// throws TransportTimeoutException on timeout.  Hang-ups and errors count as ready, so the following
+// read/write/accept reports them.
+// `wake_fd` is a non-blocking eventfd used to interrupt the wait when the stop_token is signalled;
+// pass -1 together with a default-constructed stop_token when the wait cannot be stopped.
+inline bool waitFd(int fd, short events, int wake_fd, std::chrono::microseconds timeout, std::stop_token stoken)
+{
+    std::stop_callback const on_stop(stoken, [wake_fd] {
+        uint64_t const one = 1;
+        [[maybe_unused]] auto const n = ::write(wake_fd, &one, sizeof(one));
+    });
+    auto const deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        if (stoken.stop_requested()) {
+            uint64_t drained;
+            [[maybe_unused]] auto const n = ::read(wake_fd, &drained, sizeof(drained));
+            return false;
+        }
+        auto const remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+            throw TransportTimeoutException();
+        timespec const ts{
+            .tv_sec = static_cast<time_t>(remaining.count() / 1'000'000'000),
+            .tv_nsec = static_cast<long>(remaining.count() % 1'000'000'000),
+        };
+        pollfd fds[2] = {
+            { .fd = fd, .events = events, .revents = 0 },
+            { .fd = wake_fd, .events = POLLIN, .revents = 0 },
+        };
+        auto const rc = ::ppoll(fds, 2, &ts, nullptr);
+        if (rc < 0 && errno != EINTR)
+            throwErrno("ppoll");
+        if (rc > 0 && fds[0].revents != 0)
+            return true;
+        if (rc > 0 && fds[1].revents != 0) {
+            // A stop that raced with the end of an earlier wait; stale unless it is for this one.
+            uint64_t drained;
+            [[maybe_unused]] auto const n = ::read(wake_fd, &drained, sizeof(drained));
+        }
+    }
+}
+
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include "Configuration.h"
+#include "Types.h"
+#include <RTF/RTF.h>
+#include <format>
+#include <span>
+#include <string>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace RAP::RTF {
+
+// A register target backed by a memory mapping of a device or file, e.g. a UIO map (/dev/uioN) or a memfd.
+// Register at address `addr` lives at byte offset (addr - base_addr) into the mapping.
+// Every register access is a single volatile load/store of sizeof(DataType), so hardware sees correctly sized bus cycles.
+template <IsConfigurationType Cfg>
+class MmapRegisterTarget : public ::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>
+{
+public:
+    using AddressType = typename Cfg::AddressType;
+    using DataType = typename Cfg::DataType;
+public:
+    // Map `size` bytes of `path` starting at `offset`.
+    // For UIO devices, map N is selected with offset = N * getpagesize().
+    MmapRegisterTarget(std::string_view name, std::string const& path, size_t size, off_t offset = 0, AddressType base_addr = 0)
+        : MmapRegisterTarget(name, openPath(path), size, offset, base_addr, true)
+    {}
+    // Map `size` bytes of an already open descriptor (which is not closed by this object).
+    MmapRegisterTarget(std::string_view name, int fd, size_t size, off_t offset = 0, AddressType base_addr = 0)
+        : MmapRegisterTarget(name, fd, size, offset, base_addr, false)
+    {}
+    ~MmapRegisterTarget()
+    {
+        ::munmap(const_cast<DataType*>(this->regs), this->size);
+        if (this->owns_fd)
+            ::close(this->fd);
+    }
+    MmapRegisterTarget(MmapRegisterTarget const&) = delete;
+    MmapRegisterTarget& operator=(MmapRegisterTarget const&) = delete;
+
+    virtual std::string_view getDomain() const { return "MmapRegisterTarget"; }
+
+    virtual void write(AddressType addr, DataType data) override
+    {
+        this->regs[this->index(addr, 1)] = data;
+    }
+    [[nodiscard]] virtual DataType read(AddressType addr) override
+    {
+        return this->regs[this->index(addr, 1)];
+    }
+    virtual void readModifyWrite(AddressType addr, DataType new_data, DataType mask) override
+    {
+        auto* const reg = &this->regs[this->index(addr, 1)];
+        *reg = (*reg & ~mask) | (new_data & mask);
+    }
+
+    virtual void seqWrite(AddressType start_addr, std::span<DataType const> data, size_t increment = sizeof(DataType)) override
+    {
+        if (increment == 0)
+            return this->fifoWrite(start_addr, data);
+        if (increment % sizeof(DataType) != 0)
+            return this->IRegisterTarget::seqWrite(start_addr, data, increment);
+        if (data.empty())
+            return;
+        auto const stride = increment / sizeof(DataType);
+        auto* reg = &this->regs[this->index(start_addr, (data.size() - 1) * stride + 1)];
+        for (auto const d : data) {
+            *reg = d;
+            reg += stride;
+        }
+    }
+    virtual void seqRead(AddressType start_addr, std::span<DataType> out_data, size_t increment = sizeof(DataType)) override
+    {
+        if (increment == 0)
+            return this->fifoRead(start_addr, out_data);
+        if (increment % sizeof(DataType) != 0)
+            return this->IRegisterTarget::seqRead(start_addr, out_data, increment);
+        if (out_data.empty())
+            return;
+        auto const stride = increment / sizeof(DataType);
+        auto const* reg = &this->regs[this->index(start_addr, (out_data.size() - 1) * stride + 1)];
+        for (auto& d : out_data) {
+            d = *reg;
+            reg += stride;
+        }
+    }
+
+    virtual void fifoWrite(AddressType fifo_addr, std::span<DataType const> data) override
+    {
+        auto* const reg = &this->regs[this->index(fifo_addr, 1)];
+        for (auto const d : data)
+            *reg = d;
+    }
+    virtual void fifoRead(AddressType fifo_addr, std::span<DataType> out_data) override
+    {
+        auto const* const reg = &this->regs[this->index(fifo_addr, 1)];
+        for (auto& d : out_data)
+            d = *reg;
+    }
+
+    virtual void compWrite(std::span<std::pair<AddressType, DataType> const> addr_data) override
+    {
+        for (auto const& [addr, data] : addr_data)
+            this->regs[this->index(addr, 1)] = data;
+    }
+    virtual void compRead(std::span<AddressType const> const addresses, std::span<DataType> out_data) override
+    {
+        assert(addresses.size() == out_data.size());
+        for (size_t i = 0; i < addresses.size(); i++)
+            out_data[i] = this->regs[this->index(addresses[i], 1)];
+    }
+
+private:
+    MmapRegisterTarget(std::string_view name, int fd_, size_t size_, off_t offset, AddressType base_addr_, bool owns_fd_)
+        : ::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>(name)
+        , fd(fd_)
+        , owns_fd(owns_fd_)
+        , size(size_)
+        , base_addr(base_addr_)
+        , regs(nullptr)
+    {
+        void* const p = ::mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, offset);
+        if (p == MAP_FAILED) {
+            auto const err = errno;
+            if (this->owns_fd)
+                ::close(this->fd);
+            throw std::system_error(err, std::generic_category(), "MmapRegisterTarget: mmap failed");
+        }
+        this->regs = static_cast<DataType volatile*>(p);
+    }
+    static int openPath(std::string const& path)
+    {
+        int const fd = ::open(path.c_str(), O_RDWR | O_SYNC | O_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), std::format("MmapRegisterTarget: cannot open {}", path));
+        return fd;
+    }
+    // Translate an address to a register index, checking that `count` registers starting there are inside the mapping.
+    size_t index(AddressType addr, size_t count) const
+    {
+        if (addr < this->base_addr || (addr - this->base_addr) % sizeof(DataType) != 0)
+            throw Exception(std::format("MmapRegisterTarget: invalid address 0x{:x}", addr));
+        size_t const idx = (addr - this->base_addr) / sizeof(DataType);
+        if ((idx + count) * sizeof(DataType) > this->size)
+            throw Exception(std::format("MmapRegisterTarget: address 0x{:x} outside of mapping", addr));
+        return idx;
+    }
+
+private:
+    int fd;
+    bool owns_fd;
+    size_t size;
+    AddressType base_addr;
+    DataType volatile* regs;
+};
+
+}
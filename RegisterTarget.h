@@ -3,7 +3,21 @@
 #include "Configuration.h"
 #include "Transports.h"
 #include "Serdes.h"
+#include "TargetDetail.h"
+#include "RttEstimator.h"
+#include "Stats.h"
 #include <RTF/RTF.h>
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
 
 namespace RAP::RTF {
 
@@ -13,12 +27,22 @@ class RapRegisterTarget : public ::RTF::IRegisterTarget<typename Cfg::AddressTyp
 public:
     using AddressType = typename Cfg::AddressType;
     using DataType = typename Cfg::DataType;
+    using InterruptHandler = std::function<void(RAP::Serdes::Interrupt<Cfg> const&)>;
 public:
     RapRegisterTarget(std::string_view name, std::unique_ptr<RAP::Transport::ISyncWireTransport> transport)
         : ::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>(name)
         , transport(std::move(transport))
         , serdes(this->transport->getMaxMessageSize())
-    {}
+        , tx_buffer()
+        , rx_buffer(this->transport->getMaxMessageSize())
+    {
+        if constexpr (Cfg::FeatureInterrupt) {
+            // Interrupts may arrive at any time, so a dedicated thread owns the receive side of the transport
+            // and routes responses to the waiting transaction and interrupts to the dispatcher thread.
+            this->interrupt_dispatcher = std::jthread([this](std::stop_token stoken) { this->dispatchInterrupts(stoken); });
+            this->receiver = std::jthread([this](std::stop_token stoken) { this->receiveMessages(stoken); });
+        }
+    }
     virtual std::string_view getDomain() const { return "RapRegisterTarget"; }
 
     virtual void write(AddressType addr, DataType data) override
@@ -58,119 +82,482 @@ public:
 
     virtual void seqWrite(AddressType start_addr, std::span<DataType const> data, size_t increment = sizeof(DataType)) override
     {
-        if (!this->checkIFS(increment))
+        if (!detail::checkIFS<Cfg>(increment))
              return this->IRegisterTarget::seqWrite(start_addr, data, increment);
 
-        auto const cmd = RAP::Serdes::WriteSeqCommand<Cfg>{
-            .transaction_id = this->getNextTxnId(),
-            .posted = false,
-            .start_addr = start_addr,
-            .increment = static_cast<Cfg::LengthType>(increment),
-            .data = std::vector<DataType>{ data.begin(), data.end() },
-        };
-        this->doCmdResp(cmd);
+        detail::forEachChunk(data.size(), this->serdes.getMaxSeqWriteCount(), [&](size_t offset, size_t count) {
+            this->writeSeqChunk(static_cast<AddressType>(start_addr + offset * increment), data.subspan(offset, count), increment);
+        });
     }
     virtual void seqRead(AddressType start_addr, std::span<DataType> out_data, size_t increment = sizeof(DataType)) override
     {
-        if (!this->checkIFS(increment))
+        if (!detail::checkIFS<Cfg>(increment))
             return this->IRegisterTarget::seqRead(start_addr, out_data, increment);
 
-        auto const cmd = RAP::Serdes::ReadSeqCommand<Cfg>{
-            .transaction_id = this->getNextTxnId(),
-            .start_addr = start_addr,
-            .increment = static_cast<Cfg::LengthType>(increment),
-            .count = static_cast<Cfg::LengthType>(out_data.size()),
-        };
-        auto const resp = this->doCmdResp(cmd);
-        std::copy(resp.data.begin(), resp.data.end(), out_data.begin());
+        detail::forEachChunk(out_data.size(), this->serdes.getMaxSeqReadCount(), [&](size_t offset, size_t count) {
+            auto const cmd = RAP::Serdes::ReadSeqCommand<Cfg>{
+                .transaction_id = this->getNextTxnId(),
+                .start_addr = static_cast<AddressType>(start_addr + offset * increment),
+                .increment = static_cast<Cfg::LengthType>(increment),
+                .count = static_cast<Cfg::LengthType>(count),
+            };
+            auto const resp = this->doCmdResp(cmd);
+            copyReadData(resp.data, out_data.subspan(offset, count));
+        });
     }
 
     virtual void fifoWrite(AddressType fifo_addr, std::span<DataType const> data) override
     {
         if (!Cfg::FeatureFifo)
             return this->IRegisterTarget::fifoWrite(fifo_addr, data);
-        auto const cmd = RAP::Serdes::WriteSeqCommand<Cfg>{
-            .transaction_id = this->getNextTxnId(),
-            .posted = false,
-            .start_addr = fifo_addr,
-            .increment = 0,
-            .data = std::vector<DataType>{ data.begin(), data.end() },
-        };
-        this->doCmdResp(cmd);
+        detail::forEachChunk(data.size(), this->serdes.getMaxSeqWriteCount(), [&](size_t offset, size_t count) {
+            this->writeSeqChunk(fifo_addr, data.subspan(offset, count), 0);
+        });
     }
     virtual void fifoRead(AddressType fifo_addr, std::span<DataType> out_data) override
     {
-        auto const cmd = RAP::Serdes::ReadSeqCommand<Cfg>{
-            .transaction_id = this->getNextTxnId(),
-            .start_addr = fifo_addr,
-            .increment = 0,
-            .count = static_cast<Cfg::LengthType>(out_data.size()),
-        };
-        auto const resp = this->doCmdResp(cmd);
-        std::copy(resp.data.begin(), resp.data.end(), out_data.begin());
+        detail::forEachChunk(out_data.size(), this->serdes.getMaxSeqReadCount(), [&](size_t offset, size_t count) {
+            auto const cmd = RAP::Serdes::ReadSeqCommand<Cfg>{
+                .transaction_id = this->getNextTxnId(),
+                .start_addr = fifo_addr,
+                .increment = 0,
+                .count = static_cast<Cfg::LengthType>(count),
+            };
+            auto const resp = this->doCmdResp(cmd);
+            copyReadData(resp.data, out_data.subspan(offset, count));
+        });
     }
 
     virtual void compWrite(std::span<std::pair<AddressType, DataType> const> addr_data) override
     {
         if (!Cfg::FeatureCompressed)
             return this->IRegisterTarget::compWrite(addr_data);
-        auto const cmd = RAP::Serdes::WriteCompCommand<Cfg>{
-            .transaction_id = this->getNextTxnId(),
-            .posted = false,
-            .addr_data = std::vector<std::pair<AddressType, DataType>>{ addr_data.begin(), addr_data.end() },
-        };
-        this->doCmdResp(cmd);
+        detail::forEachChunk(addr_data.size(), this->serdes.getMaxCompWriteCount(), [&](size_t offset, size_t count) {
+            auto const cmd = RAP::Serdes::WriteCompCommand<Cfg>{
+                .transaction_id = this->getNextTxnId(),
+                .posted = false,
+                .addr_data = std::vector<std::pair<AddressType, DataType>>{ addr_data.begin() + offset, addr_data.begin() + offset + count },
+            };
+            this->doCmdResp(cmd);
+        });
     }
     virtual void compRead(std::span<AddressType const> const addresses, std::span<DataType> out_data) override
     {
         assert(addresses.size() == out_data.size());
         if (!Cfg::FeatureCompressed)
             return this->IRegisterTarget::compRead(addresses, out_data);
-        auto const cmd = RAP::Serdes::ReadCompCommand<Cfg>{
-            .transaction_id = this->getNextTxnId(),
-            .addresses = std::vector<AddressType>{ addresses.begin(), addresses.end() },
-        };
-        auto const resp = this->doCmdResp(cmd);
-        std::copy(resp.data.begin(), resp.data.end(), out_data.begin());
+        detail::forEachChunk(addresses.size(), this->serdes.getMaxCompReadCount(), [&](size_t offset, size_t count) {
+            auto const cmd = RAP::Serdes::ReadCompCommand<Cfg>{
+                .transaction_id = this->getNextTxnId(),
+                .addresses = std::vector<AddressType>{ addresses.begin() + offset, addresses.begin() + offset + count },
+            };
+            auto const resp = this->doCmdResp(cmd);
+            copyReadData(resp.data, out_data.subspan(offset, count));
+        });
     }
+
+    // Register a handler to be called, on a dedicated thread, for every Interrupt received.
+    // Returns an id for removeInterruptHandler().
+    size_t addInterruptHandler(InterruptHandler handler) requires Cfg::FeatureInterrupt
+    {
+        std::lock_guard lg{ this->handlers_mtx };
+        auto const id = this->next_handler_id++;
+        this->interrupt_handlers.emplace(id, std::move(handler));
+        return id;
+    }
+    void removeInterruptHandler(size_t id) requires Cfg::FeatureInterrupt
+    {
+        std::lock_guard lg{ this->handlers_mtx };
+        this->interrupt_handlers.erase(id);
+    }
+
+    // Takes effect from the next operation and restarts the round-trip time estimate.
+    // Must not be called while an operation is in progress.
+    void setRetryPolicy(RetryPolicy const& policy)
+    {
+        if constexpr (!Cfg::FeatureInterrupt) {
+            if (policy.adaptive_timeout && !this->transport->getTimeout())
+                throw Exception("RetryPolicy::adaptive_timeout needs a transport that reports its timeout");
+        }
+        this->retry_policy = policy;
+        this->rtt = RttEstimator(policy);
+    }
+    RetryPolicy const& getRetryPolicy() const { return this->retry_policy; }
+    RttEstimator const& getRttEstimator() const { return this->rtt; }
+    // Counters and latency histograms for the operations of this target; getStats().snapshot() reads them.
+    TargetStats const& getStats() const { return this->stats; }
 private:
+    // Sends one WriteSeqCommand of at most getMaxSeqWriteCount() values.
+    void writeSeqChunk(AddressType start_addr, std::span<DataType const> data, size_t increment)
+    {
+        if constexpr (RAP::Serdes::Serdes<Cfg>::NativeDataLayout) {
+            // The payload goes to the transport straight from `data`; `cmd` only identifies the transaction.
+            auto const cmd = RAP::Serdes::WriteSeqCommand<Cfg>{
+                .transaction_id = this->getNextTxnId(),
+                .posted = false,
+                .start_addr = start_addr,
+                .increment = static_cast<Cfg::LengthType>(increment),
+                .data = {},
+            };
+            this->doCmdResp(cmd, [&] {
+                auto const parts = this->serdes.encodeSeqWriteGather(cmd.transaction_id, cmd.posted, cmd.start_addr, cmd.increment, data, this->tx_buffer, this->tx_trailer);
+                this->transport->send(std::span<BufferView const>{ parts });
+            });
+        }
+        else {
+            auto const cmd = RAP::Serdes::WriteSeqCommand<Cfg>{
+                .transaction_id = this->getNextTxnId(),
+                .posted = false,
+                .start_addr = start_addr,
+                .increment = static_cast<Cfg::LengthType>(increment),
+                .data = std::vector<DataType>{ data.begin(), data.end() },
+            };
+            this->doCmdResp(cmd);
+        }
+    }
     template <typename CmdType>
     RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::AckResponseType doCmdResp(CmdType const& cmd)
     {
-        this->transport->send(this->serdes.encodeCommand(cmd));
-        auto const resp = this->serdes.decodeResponse(this->transport->recv());
-        return std::visit([&](auto&& resp) -> RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::AckResponseType  {
-            if (cmd.transaction_id != resp.transaction_id)
-                throw RapProtocolException();
-            using T = std::decay_t<decltype(resp)>;
-            if constexpr (std::is_same_v<T, RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::AckResponseType>) {
+        return this->doCmdResp(cmd, [&] {
+            this->serdes.encodeCommand(cmd, this->tx_buffer);
+            this->transport->send(this->tx_buffer);
+        });
+    }
+    // `send` puts the command on the wire; `cmd` supplies the transaction id and expected response type.
+    template <typename CmdType, typename Send>
+    RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::AckResponseType doCmdResp(CmdType const& cmd, Send&& send)
+    {
+        auto const kind = operationKindOf<Cfg>(cmd);
+        TargetStats::InFlight const in_flight{ this->stats };
+        auto const started = std::chrono::steady_clock::now();
+        try {
+            auto const resp = this->exchange(cmd.transaction_id, isIdempotent(cmd), send);
+            this->stats.recordCompletion(kind, std::chrono::steady_clock::now() - started);
+            return std::visit([&](auto&& resp) -> RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::AckResponseType  {
+                if (cmd.transaction_id != resp.transaction_id)
+                    throw RapProtocolException();
+                using T = std::decay_t<decltype(resp)>;
+                if constexpr (std::is_same_v<T, RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::AckResponseType>) {
+                    return resp;
+                }
+                else if constexpr (std::is_same_v<T, RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::NakResponseType>) {
+                    this->stats.recordNak(resp.status);
+                    throw OperationNakException(resp.status);
+                }
+                else {
+                    throw UnexpectedMessageTypeException();
+                }
+            }, resp);
+        }
+        catch (...) {
+            this->stats.recordError(kind);
+            throw;
+        }
+    }
+    // Sends a command and waits for its response, sending it again after a timeout if it is idempotent and the
+    // retry policy allows.  Every copy carries the same transaction id, so a response to any of them completes it.
+    template <typename Send>
+    RAP::Serdes::Response<Cfg> exchange(uint8_t transaction_id, bool idempotent, Send&& send)
+    {
+        try {
+            auto resp = this->exchangeWithRetries(transaction_id, idempotent, send);
+            this->setRetired(transaction_id, true);
+            return resp;
+        }
+        catch (...) {
+            // Responses may still arrive after a timeout; they will be recognized as stale.
+            this->setRetired(transaction_id, true);
+            throw;
+        }
+    }
+    template <typename Send>
+    RAP::Serdes::Response<Cfg> exchangeWithRetries(uint8_t transaction_id, bool idempotent, Send&& send)
+    {
+        auto const retries = idempotent ? this->retry_policy.max_retries : 0;
+        for (unsigned attempt = 0;; attempt++) {
+            auto const sent_at = std::chrono::steady_clock::now();
+            try {
+                auto resp = this->exchangeOnce(transaction_id, sent_at, send);
+                // Karn's algorithm: the response to a command sent more than once may answer any copy, so it is not timed.
+                if (attempt == 0)
+                    this->rtt.addSample(std::chrono::steady_clock::now() - sent_at);
                 return resp;
             }
-            else if constexpr (std::is_same_v<T, RAP::Serdes::CommandResponseRelationshipTrait<CmdType>::NakResponseType>) {
-                throw OperationNakException(resp.status);
+            catch (RAP::Transport::TransportTimeoutException const&) {
+                this->stats.recordTimeout();
+                this->rtt.backoff();
+                if (attempt >= retries)
+                    throw;
+                this->stats.recordRetry();
+            }
+        }
+    }
+    template <typename Send>
+    RAP::Serdes::Response<Cfg> exchangeOnce(uint8_t transaction_id, std::chrono::steady_clock::time_point sent_at, Send&& send)
+    {
+        auto const adaptive = this->retry_policy.adaptive_timeout;
+        auto const deadline = sent_at + this->rtt.getTimeout();
+        if constexpr (Cfg::FeatureInterrupt) {
+            std::unique_lock lk{ this->mailbox.mtx };
+            if (this->mailbox.closed)
+                std::rethrow_exception(this->mailbox.closed);
+            this->mailbox.outstanding = true;
+            this->mailbox.transaction_id = transaction_id;
+            this->mailbox.sent_at = sent_at;
+            this->mailbox.response.reset();
+            this->mailbox.error = nullptr;
+            lk.unlock();
+            try {
+                send();
+            }
+            catch (...) {
+                lk.lock();
+                this->mailbox.outstanding = false;
+                throw;
             }
-            else {
-                throw UnexpectedMessageTypeException();
+            lk.lock();
+            auto const ready = [&] { return this->mailbox.response.has_value() || this->mailbox.error || this->mailbox.closed; };
+            if (!adaptive) {
+                this->mailbox.cv.wait(lk, ready);
             }
+            else if (!this->mailbox.cv.wait_until(lk, deadline, ready)) {
+                this->mailbox.outstanding = false;
+                throw RAP::Transport::TransportTimeoutException();
+            }
+            this->mailbox.outstanding = false;
+            if (this->mailbox.error)
+                std::rethrow_exception(std::exchange(this->mailbox.error, nullptr));
+            if (!this->mailbox.response)
+                std::rethrow_exception(this->mailbox.closed);
+            // The receiver has already dropped stale responses.
+            return *std::exchange(this->mailbox.response, std::nullopt);
+        }
+        else {
+            // Each receive borrows the transport's timeout; the configured one is put back however the exchange ends.
+            struct RestoreTimeout {
+                RAP::Transport::ISyncWireTransport& transport;
+                std::optional<std::chrono::microseconds> timeout;
+                ~RestoreTimeout()
+                {
+                    if (this->timeout)
+                        this->transport.setTimeout(*this->timeout);
+                }
+            } const restore{ *this->transport, adaptive ? this->transport->getTimeout() : std::nullopt };
+            send();
+            while (true) {
+                if (adaptive) {
+                    auto const remaining = std::chrono::ceil<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+                    if (remaining.count() <= 0)
+                        throw RAP::Transport::TransportTimeoutException();
+                    this->transport->setTimeout(remaining);
+                }
+                auto const resp_size = this->transport->recv(this->rx_buffer);
+                auto resp = this->decodeResponse(BufferView{ this->rx_buffer }.first(resp_size));
+                if (this->isStaleResponse(resp, transaction_id)) {
+                    this->stats.recordStaleResponse();
+                    continue;
+                }
+                return resp;
+            }
+        }
+    }
+    RAP::Serdes::Response<Cfg> decodeResponse(BufferView message)
+    {
+        try {
+            return this->serdes.decodeResponse(message);
+        }
+        catch (CrcMismatchException const&) {
+            this->stats.recordCrcFailure();
+            throw;
+        }
+        catch (MalformedPacketException const&) {
+            this->stats.recordMalformed();
+            throw;
+        }
+    }
+    // A response to a transaction that has already ended: late after a timeout, answering a retransmitted copy,
+    // or duplicated by the network.  It is dropped and the wait continues.  A response to an id that has not been
+    // used yet is left for doCmdResp() to report as a protocol error.
+    bool isStaleResponse(RAP::Serdes::Response<Cfg> const& resp, uint8_t transaction_id) const
+    {
+        return std::visit([&](auto const& resp) {
+            using T = std::decay_t<decltype(resp)>;
+            if constexpr (std::is_same_v<T, RAP::Serdes::Interrupt<Cfg>>)
+                return false;
+            else
+                return resp.transaction_id != transaction_id && this->retired.test(resp.transaction_id);
         }, resp);
     }
+    // A command that may be sent again: anything but a FIFO access, whose effect depends on how often it runs.
+    // A readModifyWrite with the same data and mask leaves the register as the first one did.
+    template <typename CmdType>
+    static constexpr bool isIdempotent(CmdType const& cmd)
+    {
+        if constexpr (std::is_same_v<CmdType, RAP::Serdes::ReadSeqCommand<Cfg>> || std::is_same_v<CmdType, RAP::Serdes::WriteSeqCommand<Cfg>>)
+            return cmd.increment != 0;
+        else
+            return true;
+    }
+    void receiveMessages(std::stop_token stoken)
+    {
+        constexpr std::chrono::milliseconds min_backoff{ 1 };
+        constexpr std::chrono::milliseconds max_backoff{ 100 };
+        auto backoff = min_backoff;
+        std::mutex backoff_mtx;
+        std::condition_variable_any backoff_cv;
+        while (!stoken.stop_requested()) {
+            auto const recv_started = std::chrono::steady_clock::now();
+            try {
+                auto const resp_size = this->transport->recv(this->rx_buffer, stoken);
+                if (stoken.stop_requested())
+                    return;
+                backoff = min_backoff;
+                auto resp = this->decodeResponse(BufferView{ this->rx_buffer }.first(resp_size));
+                if (auto const* irq = std::get_if<RAP::Serdes::Interrupt<Cfg>>(&resp)) {
+                    {
+                        std::lock_guard lg{ this->interrupt_queue_mtx };
+                        this->interrupt_queue.push(*irq);
+                    }
+                    this->interrupt_queue_cv.notify_one();
+                    continue;
+                }
+                std::lock_guard lg{ this->mailbox.mtx };
+                // Stale responses are dropped here, so they never take the slot from the one being waited for.
+                // A response with nobody waiting for it is a late one for an abandoned transaction.
+                if (!this->mailbox.outstanding || this->mailbox.response || this->mailbox.error || this->isStaleResponse(resp, this->mailbox.transaction_id)) {
+                    this->stats.recordStaleResponse();
+                    continue;
+                }
+                this->mailbox.response = std::move(resp);
+                this->mailbox.cv.notify_one();
+            }
+            catch (RAP::Transport::TransportClosedException const&) {
+                // Nothing more will arrive: the outstanding transaction and every later one fail with this.
+                std::lock_guard lg{ this->mailbox.mtx };
+                this->mailbox.closed = std::current_exception();
+                this->mailbox.cv.notify_one();
+                return;
+            }
+            catch (CrcMismatchException const&) {
+                // Counted by decodeResponse().  A corrupt message may well be a stale one, so rather than failing
+                // the outstanding transaction it is dropped and the transaction left to time out.
+            }
+            catch (MalformedPacketException const&) {
+                // Likewise.
+            }
+            catch (RAP::Transport::TransportTimeoutException const&) {
+                // Only time out the outstanding transaction if it was sent before this receive began,
+                // so it has been given at least the transport's full timeout.
+                std::lock_guard lg{ this->mailbox.mtx };
+                if (this->mailbox.outstanding && !this->mailbox.response && !this->mailbox.error && this->mailbox.sent_at <= recv_started) {
+                    this->mailbox.error = std::current_exception();
+                    this->mailbox.cv.notify_one();
+                }
+            }
+            catch (...) {
+                if (stoken.stop_requested())
+                    return;
+                // Transport errors belong to the outstanding transaction, if any.
+                {
+                    std::lock_guard lg{ this->mailbox.mtx };
+                    if (this->mailbox.outstanding && !this->mailbox.response && !this->mailbox.error) {
+                        this->mailbox.error = std::current_exception();
+                        this->mailbox.cv.notify_one();
+                    }
+                }
+                // Back off so that an error that persists does not keep this thread spinning.
+                std::unique_lock lk{ backoff_mtx };
+                backoff_cv.wait_for(lk, stoken, backoff, [] { return false; });
+                backoff = std::min(backoff * 2, max_backoff);
+            }
+        }
+    }
+    void dispatchInterrupts(std::stop_token stoken)
+    {
+        while (!stoken.stop_requested()) {
+            std::unique_lock lk{ this->interrupt_queue_mtx };
+            this->interrupt_queue_cv.wait(lk, stoken, [&] { return !this->interrupt_queue.empty(); });
+            if (stoken.stop_requested())
+                return;
+            auto const irq = this->interrupt_queue.front();
+            this->interrupt_queue.pop();
+            lk.unlock();
+
+            // Handlers run without the lock, so they may add or remove handlers (including themselves).
+            // A handler removed meanwhile may still see this interrupt.
+            std::map<size_t, InterruptHandler> handlers;
+            {
+                std::lock_guard lg{ this->handlers_mtx };
+                handlers = this->interrupt_handlers;
+            }
+            for (auto const& [id, handler] : handlers) {
+                try {
+                    handler(irq);
+                }
+                catch (...) {
+                    // A misbehaving handler must not stop delivery to the others.
+                }
+            }
+        }
+    }
     uint8_t getNextTxnId()
     {
-        return this->next_txn_id.fetch_add(1);
+        auto const transaction_id = this->next_txn_id.fetch_add(1);
+        // From now on a response carrying this id belongs to the new transaction.
+        this->setRetired(transaction_id, false);
+        return transaction_id;
     }
-    bool checkIFS(size_t increment) const
+    // `retired` is read by the receiver thread, under the mailbox lock, when Cfg::FeatureInterrupt is set.
+    void setRetired(uint8_t transaction_id, bool value)
     {
-        if (Cfg::FeatureIncrement)
-            return true;
-        if (increment == 0 && Cfg::FeatureFifo)
-            return true;
-        if (increment == sizeof(Cfg::DataType) && Cfg::FeatureSequential)
-            return true;
-        return false;
+        if constexpr (Cfg::FeatureInterrupt) {
+            std::lock_guard lg{ this->mailbox.mtx };
+            this->retired.set(transaction_id, value);
+        }
+        else {
+            this->retired.set(transaction_id, value);
+        }
+    }
+    // The reply to a read must carry exactly the items asked for.
+    static void copyReadData(std::span<DataType const> data, std::span<DataType> out)
+    {
+        if (data.size() != out.size())
+            throw RapProtocolException("Read response does not carry the requested number of items.");
+        std::copy(data.begin(), data.end(), out.begin());
     }
 private:
     std::unique_ptr<RAP::Transport::ISyncWireTransport> transport;
     RAP::Serdes::Serdes<Cfg> serdes;
+    // Reused for every message.  rx_buffer belongs to the receiver thread when Cfg::FeatureInterrupt is set.
+    Buffer tx_buffer;
+    Buffer tx_trailer;
+    Buffer rx_buffer;
     std::atomic<uint8_t> next_txn_id;
+    RetryPolicy retry_policy;
+    RttEstimator rtt;
+    // Transaction ids whose transaction has ended, until they are used again.
+    std::bitset<256> retired;
+    TargetStats stats;
+
+    // Only used when Cfg::FeatureInterrupt is set.
+    struct {
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool outstanding = false;
+        uint8_t transaction_id = 0;
+        std::chrono::steady_clock::time_point sent_at;
+        std::optional<RAP::Serdes::Response<Cfg>> response;
+        std::exception_ptr error;
+        // Set once the transport has been closed; the receiver has ended.
+        std::exception_ptr closed;
+    } mailbox;
+    std::mutex interrupt_queue_mtx;
+    std::condition_variable_any interrupt_queue_cv;
+    std::queue<RAP::Serdes::Interrupt<Cfg>> interrupt_queue;
+    std::mutex handlers_mtx;
+    std::map<size_t, InterruptHandler> interrupt_handlers;
+    size_t next_handler_id = 0;
+    std::jthread interrupt_dispatcher;
+    std::jthread receiver;
 };
 }
@@ -0,0 +1,215 @@
+#pragma once
+#include "Configuration.h"
+#include "TargetDetail.h"
+#include "Types.h"
+#include <RTF/RTF.h>
+#include <algorithm>
+#include <format>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace RAP::RTF {
+
+struct RouterOptions {
+    // Batches with at least this many registers that touch more than one backend
+    // are executed with one task per backend; smaller batches run on the calling thread.
+    size_t parallel_threshold = 256;
+};
+
+// Decodes addresses to backend targets, like a bus interconnect.
+// Each route maps [base, base + size) to a backend, which sees addresses relative to `base`.
+// Batched operations spanning several routes are split into one sub-batch per backend;
+// sub-batches run in parallel and results are reassembled in the original order.
+// Operations on the same backend are always issued in their original order from a single thread.
+template <IsConfigurationType Cfg>
+class RouterRegisterTarget : public ::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>
+{
+public:
+    using AddressType = typename Cfg::AddressType;
+    using DataType = typename Cfg::DataType;
+    using TargetType = ::RTF::IRegisterTarget<AddressType, DataType>;
+public:
+    RouterRegisterTarget(std::string_view name, RouterOptions options_ = {})
+        : ::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>(name)
+        , options(options_)
+    {}
+    virtual std::string_view getDomain() const { return "RouterRegisterTarget"; }
+
+    // Routes must not overlap.  Not thread-safe with respect to operations; configure routes before use.
+    void addRoute(AddressType base, size_t size, std::shared_ptr<TargetType> target)
+    {
+        if (size == 0 || !target)
+            throw Exception("RouterRegisterTarget: invalid route");
+        auto const it = std::lower_bound(this->routes.begin(), this->routes.end(), base, [](Route const& r, AddressType a) { return r.base < a; });
+        if (it != this->routes.end() && it->base < base + size)
+            throw Exception(std::format("RouterRegisterTarget: route at 0x{:x} overlaps an existing route", base));
+        if (it != this->routes.begin() && std::prev(it)->base + std::prev(it)->size > base)
+            throw Exception(std::format("RouterRegisterTarget: route at 0x{:x} overlaps an existing route", base));
+        this->routes.insert(it, Route{ .base = base, .size = size, .target = target.get() });
+        if (std::find(this->backends.begin(), this->backends.end(), target) == this->backends.end())
+            this->backends.push_back(std::move(target));
+    }
+
+    virtual void write(AddressType addr, DataType data) override
+    {
+        auto const& r = this->route(addr);
+        r.target->write(addr - r.base, data);
+    }
+    [[nodiscard]] virtual DataType read(AddressType addr) override
+    {
+        auto const& r = this->route(addr);
+        return r.target->read(addr - r.base);
+    }
+    virtual void readModifyWrite(AddressType addr, DataType new_data, DataType mask) override
+    {
+        auto const& r = this->route(addr);
+        r.target->readModifyWrite(addr - r.base, new_data, mask);
+    }
+
+    virtual void seqWrite(AddressType start_addr, std::span<DataType const> data, size_t increment = sizeof(DataType)) override
+    {
+        if (increment == 0)
+            return this->fifoWrite(start_addr, data);
+        auto const segments = this->splitSeq(start_addr, data.size(), increment);
+        this->runPerBackend(segments, data.size(), [&](Segment const& s) {
+            s.route->target->seqWrite(s.local_addr, data.subspan(s.first, s.count), increment);
+        });
+    }
+    virtual void seqRead(AddressType start_addr, std::span<DataType> out_data, size_t increment = sizeof(DataType)) override
+    {
+        if (increment == 0)
+            return this->fifoRead(start_addr, out_data);
+        auto const segments = this->splitSeq(start_addr, out_data.size(), increment);
+        this->runPerBackend(segments, out_data.size(), [&](Segment const& s) {
+            s.route->target->seqRead(s.local_addr, out_data.subspan(s.first, s.count), increment);
+        });
+    }
+
+    virtual void fifoWrite(AddressType fifo_addr, std::span<DataType const> data) override
+    {
+        auto const& r = this->route(fifo_addr);
+        r.target->fifoWrite(fifo_addr - r.base, data);
+    }
+    virtual void fifoRead(AddressType fifo_addr, std::span<DataType> out_data) override
+    {
+        auto const& r = this->route(fifo_addr);
+        r.target->fifoRead(fifo_addr - r.base, out_data);
+    }
+
+    virtual void compWrite(std::span<std::pair<AddressType, DataType> const> addr_data) override
+    {
+        std::vector<CompBatch> batches;
+        for (size_t i = 0; i < addr_data.size(); i++) {
+            auto const& r = this->route(addr_data[i].first);
+            this->batchFor(batches, r.target).addr_data.emplace_back(addr_data[i].first - r.base, addr_data[i].second);
+        }
+        this->runBatches(batches, addr_data.size(), [](CompBatch& b) {
+            b.target->compWrite(b.addr_data);
+        });
+    }
+    virtual void compRead(std::span<AddressType const> const addresses, std::span<DataType> out_data) override
+    {
+        assert(addresses.size() == out_data.size());
+        std::vector<CompBatch> batches;
+        for (size_t i = 0; i < addresses.size(); i++) {
+            auto const& r = this->route(addresses[i]);
+            auto& b = this->batchFor(batches, r.target);
+            b.addresses.push_back(addresses[i] - r.base);
+            b.positions.push_back(i);
+        }
+        this->runBatches(batches, addresses.size(), [&](CompBatch& b) {
+            std::vector<DataType> data(b.addresses.size());
+            b.target->compRead(b.addresses, data);
+            for (size_t i = 0; i < data.size(); i++)
+                out_data[b.positions[i]] = data[i];
+        });
+    }
+
+private:
+    struct Route {
+        AddressType base;
+        size_t size;
+        TargetType* target;
+    };
+    // A contiguous run of a sequential operation that falls within one route.
+    struct Segment {
+        Route const* route;
+        AddressType local_addr;
+        size_t first;
+        size_t count;
+    };
+    struct CompBatch {
+        TargetType* target;
+        std::vector<AddressType> addresses;
+        std::vector<size_t> positions;
+        std::vector<std::pair<AddressType, DataType>> addr_data;
+    };
+
+    Route const& route(AddressType addr) const
+    {
+        auto const it = std::upper_bound(this->routes.begin(), this->routes.end(), addr, [](AddressType a, Route const& r) { return a < r.base; });
+        if (it == this->routes.begin() || addr - std::prev(it)->base >= std::prev(it)->size)
+            throw Exception(std::format("RouterRegisterTarget: no route for address 0x{:x}", addr));
+        return *std::prev(it);
+    }
+    std::vector<Segment> splitSeq(AddressType start_addr, size_t count, size_t increment) const
+    {
+        std::vector<Segment> segments;
+        size_t i = 0;
+        while (i < count) {
+            AddressType const addr = static_cast<AddressType>(start_addr + i * increment);
+            auto const& r = this->route(addr);
+            size_t const remaining_in_route = (r.size - (addr - r.base) + increment - 1) / increment;
+            size_t const n = std::min(count - i, remaining_in_route);
+            segments.push_back(Segment{ .route = &r, .local_addr = static_cast<AddressType>(addr - r.base), .first = i, .count = n });
+            i += n;
+        }
+        return segments;
+    }
+    CompBatch& batchFor(std::vector<CompBatch>& batches, TargetType* target) const
+    {
+        auto const it = std::find_if(batches.begin(), batches.end(), [&](CompBatch const& b) { return b.target == target; });
+        if (it != batches.end())
+            return *it;
+        return batches.emplace_back(CompBatch{ .target = target });
+    }
+    template <typename Fn>
+    void runPerBackend(std::vector<Segment> const& segments, size_t total, Fn&& fn)
+    {
+        struct SeqBatch {
+            TargetType* target;
+            std::vector<Segment const*> segments;
+        };
+        std::vector<SeqBatch> batches;
+        for (auto const& s : segments) {
+            auto const it = std::find_if(batches.begin(), batches.end(), [&](SeqBatch const& b) { return b.target == s.route->target; });
+            if (it != batches.end())
+                it->segments.push_back(&s);
+            else
+                batches.push_back(SeqBatch{ .target = s.route->target, .segments = { &s } });
+        }
+        this->runBatches(batches, total, [&](SeqBatch& b) {
+            for (auto const* s : b.segments)
+                fn(*s);
+        });
+    }
+    // Run fn on each batch; batches other than the first are run on their own task when worthwhile.
+    template <typename Batch, typename Fn>
+    void runBatches(std::vector<Batch>& batches, size_t total, Fn&& fn)
+    {
+        if (batches.size() <= 1 || total < this->options.parallel_threshold) {
+            for (auto& b : batches)
+                fn(b);
+            return;
+        }
+        detail::runParallel(batches.size(), [&](size_t i) { fn(batches[i]); });
+    }
+
+private:
+    RouterOptions options;
+    std::vector<Route> routes;
+    std::vector<std::shared_ptr<TargetType>> backends;
+};
+
+}
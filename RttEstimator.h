@@ -0,0 +1,79 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+
+namespace RAP {
+
+// How RapRegisterTarget recovers from lost messages.  The defaults keep the transport's fixed timeout and no retries.
+struct RetryPolicy {
+    // Times an idempotent operation (a read, or a write to anything but a FIFO) is sent again after timing out.
+    unsigned max_retries = 0;
+    // Size each attempt's timeout from the measured round-trip time instead of using the transport's timeout.
+    bool adaptive_timeout = false;
+    // Timeout used until the first round trip has been measured.
+    std::chrono::microseconds initial_timeout = std::chrono::seconds(1);
+    // Bounds on the adaptive timeout.  RFC 6298 asks for at least one second on the Internet;
+    // devices on a local link answer in microseconds, so the floor is much lower here.
+    std::chrono::microseconds min_timeout = std::chrono::milliseconds(1);
+    std::chrono::microseconds max_timeout = std::chrono::seconds(60);
+};
+
+// Retransmission timeout estimation after RFC 6298: a smoothed round-trip time (SRTT) and its mean deviation
+// (RTTVAR), giving a timeout of SRTT + 4 * RTTVAR.  The timeout doubles on every expiry, up to the maximum,
+// until a new sample is taken.  Only time round trips of commands sent once (Karn's algorithm).
+class RttEstimator
+{
+public:
+    RttEstimator() : RttEstimator(RetryPolicy{}) {}
+    explicit RttEstimator(RetryPolicy const& policy)
+        : initial_timeout(policy.initial_timeout)
+        , min_timeout(policy.min_timeout)
+        , max_timeout(policy.max_timeout)
+        , timeout(std::clamp(policy.initial_timeout, policy.min_timeout, policy.max_timeout))
+    {}
+
+    void addSample(std::chrono::nanoseconds rtt)
+    {
+        if (!this->has_sample) {
+            this->srtt = rtt;
+            this->rttvar = rtt / 2;
+            this->has_sample = true;
+        }
+        else {
+            auto const error = this->srtt > rtt ? this->srtt - rtt : rtt - this->srtt;
+            this->rttvar = (3 * this->rttvar + error) / 4;
+            this->srtt = (7 * this->srtt + rtt) / 8;
+        }
+        auto const rto = std::chrono::ceil<std::chrono::microseconds>(this->srtt + std::max<std::chrono::nanoseconds>(clock_granularity, 4 * this->rttvar));
+        this->timeout = std::clamp(rto, this->min_timeout, this->max_timeout);
+    }
+    // The current timeout expired.
+    void backoff()
+    {
+        this->timeout = std::min(this->timeout * 2, this->max_timeout);
+    }
+    void reset()
+    {
+        this->has_sample = false;
+        this->srtt = {};
+        this->rttvar = {};
+        this->timeout = std::clamp(this->initial_timeout, this->min_timeout, this->max_timeout);
+    }
+
+    std::chrono::microseconds getTimeout() const { return this->timeout; }
+    bool hasSample() const { return this->has_sample; }
+    std::chrono::nanoseconds getSmoothedRtt() const { return this->srtt; }
+    std::chrono::nanoseconds getRttVariation() const { return this->rttvar; }
+
+private:
+    static constexpr std::chrono::nanoseconds clock_granularity = std::chrono::microseconds(1);
+    std::chrono::microseconds initial_timeout;
+    std::chrono::microseconds min_timeout;
+    std::chrono::microseconds max_timeout;
+    std::chrono::microseconds timeout;
+    std::chrono::nanoseconds srtt{};
+    std::chrono::nanoseconds rttvar{};
+    bool has_sample = false;
+};
+
+}
@@ -5,6 +5,8 @@
 #define CRCPP_BRANCHLESS
 #define CRCPP_USE_CPP11
 #include "CRCpp/inc/CRC.h"
+#include <array>
+#include <bit>
 #include <limits>
 #include <span>
 #include <variant>
@@ -276,8 +278,15 @@ public:
 
     Buffer encodeCommand(Command<Cfg> const& cmd) const
     {
-        return std::visit([&](auto&& cmd) -> Buffer {
-            return this->encode(cmd);
+        Buffer buf{};
+        this->encodeCommand(cmd, buf);
+        return buf;
+    }
+    // Encodes into `buf`, replacing its contents.
+    void encodeCommand(Command<Cfg> const& cmd, Buffer& buf) const
+    {
+        std::visit([&](auto&& cmd) {
+            this->encode(cmd, buf);
         }, cmd);
     }
     Response<Cfg> decodeResponse(BufferView buff) const
@@ -371,11 +380,60 @@ public:
     }
     Buffer encodeResponse(Response<Cfg> const& resp) const
     {
-        return std::visit([&](auto&& resp) -> Buffer {
-            return this->encode(resp);
+        Buffer buf{};
+        this->encodeResponse(resp, buf);
+        return buf;
+    }
+    // Encodes into `buf`, replacing its contents.
+    void encodeResponse(Response<Cfg> const& resp, Buffer& buf) const
+    {
+        std::visit([&](auto&& resp) {
+            this->encode(resp, buf);
         }, resp);
     }
 
+    // True when DataType values are laid out in memory exactly as on the wire (little-endian, full width),
+    // so a span of them can be sent as a message payload without re-packing.
+    static constexpr bool NativeDataLayout = Cfg::DataBytes == sizeof(typename Cfg::DataType) && std::endian::native == std::endian::little;
+
+    // Gather form of encoding a WriteSeqCommand (or a FIFO write, with increment 0) whose payload is `data`.
+    // Only the header and CRC are written, into `header` and `trailer`; `data` is referenced, not copied.
+    // The returned parts, header + payload + trailer, are for ISyncWireTransport::send(std::span<BufferView const>)
+    // and are valid as long as `data`, `header` and `trailer` are.
+    std::array<BufferView, 3> encodeSeqWriteGather(uint8_t transaction_id, bool posted, Cfg::AddressType start_addr, Cfg::LengthType increment,
+        std::span<typename Cfg::DataType const> data, Buffer& header, Buffer& trailer) const requires NativeDataLayout
+    {
+        if (data.size() > this->getMaxSeqWriteCount())
+            throw MessageSizeException("WriteSeqCommand count exceeded transport-imposed limit");
+        startBuffer(header, calcSize(1, 0, 2) - Cfg::CrcBytes, transaction_id, posted ? MessageType::eCmdSeqWritePosted : MessageType::eCmdSeqWrite);
+        appendAddress(header, start_addr);
+        appendLength(header, increment);
+        appendLength(header, static_cast<typename Cfg::LengthType>(data.size()));
+        auto const payload = std::as_bytes(data);
+        std::array<BufferView, 3> parts{
+            BufferView{ header },
+            BufferView{ reinterpret_cast<uint8_t const*>(payload.data()), payload.size() },
+            BufferView{},
+        };
+        auto const crc = calculateCrc(std::span{ parts }.first(2));
+        trailer.clear();
+        for (size_t i = 0; i < Cfg::CrcBytes; i++) {
+            trailer.push_back(crc >> (i*8));
+        }
+        parts[2] = BufferView{ trailer };
+        return parts;
+    }
+
+    // True if `buff` is long enough to be a message and its trailing CRC matches its contents.
+    // Lets framing layers tell real messages from line noise without decoding them.
+    bool checkCrc(BufferView buff) const
+    {
+        if (buff.size() < 2 + Cfg::CrcBytes)
+            return false;
+        auto const wire_crc = extractCrc(buff);
+        return wire_crc == calculateCrc(buff);
+    }
+
     Cfg::LengthType getMaxSeqReadCount() const
     {
         // Size is determined by Ack Response AND Length field
@@ -439,13 +497,13 @@ private:
             throw MessageSizeException("Serialized message too large to fit in Transport limits");
         return sz;
     }
-    Buffer mkBuffer(size_t sz, uint8_t txn_id, MessageType msg_type) const
+    // Reuses the capacity of `buf`, so encoding into a long-lived or pooled buffer does not allocate.
+    void startBuffer(Buffer& buf, size_t sz, uint8_t txn_id, MessageType msg_type) const
     {
-        Buffer buf{};
+        buf.clear();
         buf.reserve(sz);
         appendByte(buf, txn_id);
         appendByte(buf, static_cast<uint8_t>(msg_type));
-        return buf;
     }
     void appendByte(Buffer& buf, uint8_t v) const
     {
@@ -562,6 +620,18 @@ private:
         return v;
     }
     Cfg::CrcType calculateCrc(BufferView buf) const
+    {
+        return CRCPP::CRC::Calculate(buf.data(), buf.size(), crcTable());
+    }
+    // CRC of the concatenation of `parts`.
+    Cfg::CrcType calculateCrc(std::span<BufferView const> parts) const
+    {
+        auto crc = CRCPP::CRC::Calculate(parts[0].data(), parts[0].size(), crcTable());
+        for (auto const part : parts.subspan(1))
+            crc = CRCPP::CRC::Calculate(part.data(), part.size(), crcTable(), crc);
+        return crc;
+    }
+    static auto const& crcTable()
     {
         if constexpr (Cfg::CrcBytes == 1) {
             static auto const table = CRCPP::CRC::Parameters<Cfg::CrcType, 8>{ // CRC-8/DVB-S2
@@ -571,7 +641,7 @@ private:
                 .reflectInput = false,
                 .reflectOutput = false,
             }.MakeTable();
-            return CRCPP::CRC::Calculate(buf.data(), buf.size(), table);
+            return table;
         }
         else if constexpr (Cfg::CrcBytes == 2) {
             static auto const table = CRCPP::CRC::Parameters<Cfg::CrcType, 16>{ // CRC-16/XMODEM
@@ -581,7 +651,7 @@ private:
                 .reflectInput = false,
                 .reflectOutput = false,
             }.MakeTable();
-            return CRCPP::CRC::Calculate(buf.data(), buf.size(), table);
+            return table;
         }
         else if constexpr (Cfg::CrcBytes == 3) {
             static auto const table = CRCPP::CRC::Parameters<Cfg::CrcType, 24>{ // CRC-24/INTERLAKEN
@@ -591,7 +661,7 @@ private:
                 .reflectInput = false,
                 .reflectOutput = false,
             }.MakeTable();
-            return CRCPP::CRC::Calculate(buf.data(), buf.size(), table);
+            return table;
         }
         else if constexpr (Cfg::CrcBytes == 4) {
             static auto const table = CRCPP::CRC::Parameters<Cfg::CrcType, 32>{ // CRC-32/INTERLAKEN
@@ -601,20 +671,19 @@ private:
                 .reflectInput = true,
                 .reflectOutput = true,
             }.MakeTable();
-            return CRCPP::CRC::Calculate(buf.data(), buf.size(), table);
+            return table;
         }
     }
 private:
     template <typename T>
     T decode(BufferView buf, uint8_t txn_id, MessageType msg_type) const { static_assert(false); }
-    Buffer encode(ReadSingleCommand<Cfg> const& cmd) const
+    void encode(ReadSingleCommand<Cfg> const& cmd, Buffer& buf) const
     {
         auto const sz = calcSize(1, 0, 0);
-        auto buf = mkBuffer(sz, cmd.transaction_id, MessageType::eCmdSingleRead);
+        startBuffer(buf, sz, cmd.transaction_id, MessageType::eCmdSingleRead);
         appendAddress(buf, cmd.addr);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> ReadSingleCommand<Cfg> decode<ReadSingleCommand<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -625,15 +694,14 @@ private:
             .addr = addr,
         };
     }
-    Buffer encode(WriteSingleCommand<Cfg> const& cmd) const
+    void encode(WriteSingleCommand<Cfg> const& cmd, Buffer& buf) const
     {
         auto const sz = calcSize(1, 1, 0);
-        auto buf = mkBuffer(sz, cmd.transaction_id, cmd.posted ? MessageType::eCmdSingleWritePosted : MessageType::eCmdSingleWrite);
+        startBuffer(buf, sz, cmd.transaction_id, cmd.posted ? MessageType::eCmdSingleWritePosted : MessageType::eCmdSingleWrite);
         appendAddress(buf, cmd.addr);
         appendData(buf, cmd.data);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> WriteSingleCommand<Cfg> decode<WriteSingleCommand<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -647,18 +715,17 @@ private:
             .data = data,
         };
     }
-    Buffer encode(ReadSeqCommand<Cfg> const& cmd) const
+    void encode(ReadSeqCommand<Cfg> const& cmd, Buffer& buf) const
     {
         if (cmd.count > this->getMaxSeqReadCount())
             throw MessageSizeException("ReadSeqCommand count exceeded transport-imposed limit");
         auto const sz = calcSize(1, 0, 2);
-        auto buf = mkBuffer(sz, cmd.transaction_id, MessageType::eCmdSeqRead);
+        startBuffer(buf, sz, cmd.transaction_id, MessageType::eCmdSeqRead);
         appendAddress(buf, cmd.start_addr);
         appendLength(buf, cmd.increment);
         appendLength(buf, cmd.count);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> ReadSeqCommand<Cfg> decode<ReadSeqCommand<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -673,12 +740,12 @@ private:
             .count = count,
         };
     }
-    Buffer encode(WriteSeqCommand<Cfg> const& cmd) const
+    void encode(WriteSeqCommand<Cfg> const& cmd, Buffer& buf) const
     {
         if (cmd.data.size() > this->getMaxSeqWriteCount())
             throw MessageSizeException("WriteSeqCommand count exceeded transport-imposed limit");
         auto const sz = calcSize(1, cmd.data.size(), 2);
-        auto buf = mkBuffer(sz, cmd.transaction_id, cmd.posted ? MessageType::eCmdSeqWritePosted : MessageType::eCmdSeqWrite);
+        startBuffer(buf, sz, cmd.transaction_id, cmd.posted ? MessageType::eCmdSeqWritePosted : MessageType::eCmdSeqWrite);
         appendAddress(buf, cmd.start_addr);
         appendLength(buf, cmd.increment);
         appendLength(buf, cmd.data.size());
@@ -686,7 +753,6 @@ private:
             appendData(buf, d);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> WriteSeqCommand<Cfg> decode<WriteSeqCommand<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -705,18 +771,17 @@ private:
             .data = std::move(data)
         };
     }
-    Buffer encode(ReadCompCommand<Cfg> const& cmd) const
+    void encode(ReadCompCommand<Cfg> const& cmd, Buffer& buf) const
     {
         if (cmd.addresses.size() > this->getMaxCompReadCount())
             throw MessageSizeException("ReadCompCommand count exceeded transport-imposed limit");
         auto const sz = calcSize(cmd.addresses.size(), 0, 1);
-        auto buf = mkBuffer(sz, cmd.transaction_id, MessageType::eCmdCompRead);
+        startBuffer(buf, sz, cmd.transaction_id, MessageType::eCmdCompRead);
         appendLength(buf, cmd.addresses.size());
         for (auto const a : cmd.addresses)
             appendAddress(buf, a);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> ReadCompCommand<Cfg> decode<ReadCompCommand<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -730,12 +795,12 @@ private:
             .addresses = std::move(addrs),
         };
     }
-    Buffer encode(WriteCompCommand<Cfg> const& cmd) const
+    void encode(WriteCompCommand<Cfg> const& cmd, Buffer& buf) const
     {
         if (cmd.addr_data.size() > this->getMaxCompWriteCount())
             throw MessageSizeException("WriteCompCommand count exceeded transport-imposed limit");
         auto const sz = calcSize(cmd.addr_data.size(), cmd.addr_data.size(), 1);
-        auto buf = mkBuffer(sz, cmd.transaction_id, cmd.posted ? MessageType::eCmdCompWritePosted : MessageType::eCmdCompWrite);
+        startBuffer(buf, sz, cmd.transaction_id, cmd.posted ? MessageType::eCmdCompWritePosted : MessageType::eCmdCompWrite);
         appendLength(buf, cmd.addr_data.size());
         for (auto const ad : cmd.addr_data) {
             appendAddress(buf, ad.first);
@@ -743,7 +808,6 @@ private:
         }
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> WriteCompCommand<Cfg> decode<WriteCompCommand<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -758,16 +822,15 @@ private:
             .addr_data = std::move(addr_data),
         };
     }
-    Buffer encode(ReadModifyWriteCommand<Cfg> const& cmd) const
+    void encode(ReadModifyWriteCommand<Cfg> const& cmd, Buffer& buf) const
     {
         auto const sz = calcSize(1, 2, 0);
-        auto buf = mkBuffer(sz, cmd.transaction_id, cmd.posted ? MessageType::eCmdSingleRmwPosted : MessageType::eCmdSingleRmw);
+        startBuffer(buf, sz, cmd.transaction_id, cmd.posted ? MessageType::eCmdSingleRmwPosted : MessageType::eCmdSingleRmw);
         appendAddress(buf, cmd.addr);
         appendData(buf, cmd.data);
         appendData(buf, cmd.mask);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> ReadModifyWriteCommand<Cfg> decode<ReadModifyWriteCommand<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -783,14 +846,13 @@ private:
             .mask = mask,
         };
     }
-    Buffer encode(ReadSingleAckResponse<Cfg> const& resp) const
+    void encode(ReadSingleAckResponse<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 1, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eAckSingleRead);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eAckSingleRead);
         appendData(buf, resp.data);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> ReadSingleAckResponse<Cfg> decode<ReadSingleAckResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -801,13 +863,12 @@ private:
             .data = data,
         };
     }
-    Buffer encode(WriteSingleAckResponse<Cfg> const& resp) const
+    void encode(WriteSingleAckResponse<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 0, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eAckSingleWrite);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eAckSingleWrite);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> WriteSingleAckResponse<Cfg> decode<WriteSingleAckResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -816,18 +877,17 @@ private:
             .transaction_id = txn_id,
         };
     }
-    Buffer encode(ReadSeqAckResponse<Cfg> const& resp) const
+    void encode(ReadSeqAckResponse<Cfg> const& resp, Buffer& buf) const
     {
         if (resp.data.size() > this->getMaxSeqReadCount())
             throw MessageSizeException("ReadSeqAckResponse count exceeded transport-imposed limit");
         auto const sz = calcSize(0, resp.data.size(), 1);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eAckSeqRead);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eAckSeqRead);
         appendLength(buf, resp.data.size());
         for (auto const d : resp.data)
             appendData(buf, d);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> ReadSeqAckResponse<Cfg> decode<ReadSeqAckResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -839,13 +899,12 @@ private:
             .data = std::move(data),
         };
     }
-    Buffer encode(WriteSeqAckResponse<Cfg> const& resp) const
+    void encode(WriteSeqAckResponse<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 0, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eAckSeqWrite);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eAckSeqWrite);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> WriteSeqAckResponse<Cfg> decode<WriteSeqAckResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -854,18 +913,17 @@ private:
             .transaction_id = txn_id,
         };
     }
-    Buffer encode(ReadCompAckResponse<Cfg> const& resp) const
+    void encode(ReadCompAckResponse<Cfg> const& resp, Buffer& buf) const
     {
         if (resp.data.size() > this->getMaxCompReadCount())
             throw MessageSizeException("ReadCompAckResponse count exceeded transport-imposed limit");
         auto const sz = calcSize(0, resp.data.size(), 1);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eAckCompRead);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eAckCompRead);
         appendLength(buf, resp.data.size());
         for (auto const d : resp.data)
             appendData(buf, d);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> ReadCompAckResponse<Cfg> decode<ReadCompAckResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -877,13 +935,12 @@ private:
             .data = std::move(data),
         };
     }
-    Buffer encode(WriteCompAckResponse<Cfg> const& resp) const
+    void encode(WriteCompAckResponse<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 0, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eAckCompWrite);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eAckCompWrite);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> WriteCompAckResponse<Cfg> decode<WriteCompAckResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -892,14 +949,13 @@ private:
             .transaction_id = txn_id,
         };
     }
-    Buffer encode(ReadSingleNakResponse<Cfg> const& resp) const
+    void encode(ReadSingleNakResponse<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 1, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eNakSingleRead);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eNakSingleRead);
         appendData(buf, resp.status);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> ReadSingleNakResponse<Cfg> decode<ReadSingleNakResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -910,14 +966,13 @@ private:
             .status = status,
         };
     }
-    Buffer encode(WriteSingleNakResponse<Cfg> const& resp) const
+    void encode(WriteSingleNakResponse<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 1, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eNakSingleWrite);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eNakSingleWrite);
         appendData(buf, resp.status);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> WriteSingleNakResponse<Cfg> decode<WriteSingleNakResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -928,14 +983,13 @@ private:
             .status = status,
         };
     }
-    Buffer encode(ReadSeqNakResponse<Cfg> const& resp) const
+    void encode(ReadSeqNakResponse<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 1, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eNakSeqRead);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eNakSeqRead);
         appendData(buf, resp.status);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> ReadSeqNakResponse<Cfg> decode<ReadSeqNakResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -946,14 +1000,13 @@ private:
             .status = status,
         };
     }
-    Buffer encode(WriteSeqNakResponse<Cfg> const& resp) const
+    void encode(WriteSeqNakResponse<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 1, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eNakSeqWrite);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eNakSeqWrite);
         appendData(buf, resp.status);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> WriteSeqNakResponse<Cfg> decode<WriteSeqNakResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -964,14 +1017,13 @@ private:
             .status = status,
         };
     }
-    Buffer encode(ReadCompNakResponse<Cfg> const& resp) const
+    void encode(ReadCompNakResponse<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 1, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eNakCompRead);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eNakCompRead);
         appendData(buf, resp.status);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> ReadCompNakResponse<Cfg> decode<ReadCompNakResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -982,14 +1034,13 @@ private:
             .status = status,
         };
     }
-    Buffer encode(WriteCompNakResponse<Cfg> const& resp) const
+    void encode(WriteCompNakResponse<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 1, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eNakCompWrite);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eNakCompWrite);
         appendData(buf, resp.status);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> WriteCompNakResponse<Cfg> decode<WriteCompNakResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -1000,13 +1051,12 @@ private:
             .status = status,
         };
     }
-    Buffer encode(ReadmodifywriteSingleAckResponse<Cfg> const& resp) const
+    void encode(ReadmodifywriteSingleAckResponse<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 0, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eAckSingleRmw);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eAckSingleRmw);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> ReadmodifywriteSingleAckResponse<Cfg> decode<ReadmodifywriteSingleAckResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -1015,14 +1065,13 @@ private:
             .transaction_id = txn_id,
         };
     }
-    Buffer encode(ReadmodifywriteSingleNakResponse<Cfg> const& resp) const
+    void encode(ReadmodifywriteSingleNakResponse<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 1, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eNakSingleRmw);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eNakSingleRmw);
         appendData(buf, resp.status);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> ReadmodifywriteSingleNakResponse<Cfg> decode<ReadmodifywriteSingleNakResponse<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -1033,14 +1082,13 @@ private:
             .status = status,
         };
     }
-    Buffer encode(Interrupt<Cfg> const& resp) const
+    void encode(Interrupt<Cfg> const& resp, Buffer& buf) const
     {
         auto const sz = calcSize(0, 1, 0);
-        auto buf = mkBuffer(sz, resp.transaction_id, MessageType::eAckSingleInterrupt);
+        startBuffer(buf, sz, resp.transaction_id, MessageType::eAckSingleInterrupt);
         appendData(buf, resp.status);
         appendCrc(buf);
         assert(buf.size() == sz);
-        return buf;
     }
     template <> Interrupt<Cfg> decode<Interrupt<Cfg>>(BufferView buf, uint8_t txn_id, MessageType msg_type) const
     {
@@ -1,24 +1,69 @@
 #pragma once
 #include "Configuration.h"
 #include "Types.h"
+#include "BufferPool.h"
 #include "Transports.h"
 #include "Serdes.h"
+#include "Stats.h"
 #include <RTF/RTF.h>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <thread>
 
 namespace RAP::RTF {
 
+    struct InterruptPolicy {
+        // Interrupts raised within this window of the first pending one are merged into a single message.
+        std::chrono::microseconds coalesce_window{ 0 };
+        // Minimum time between two interrupt messages.
+        std::chrono::microseconds min_interval{ 0 };
+    };
+
     template <RAP::IsConfigurationType Cfg>
     class RapServerAdapter
     {
     public:
-        RapServerAdapter(std::unique_ptr<RAP::Transport::ISyncWireTransport> transport_, std::shared_ptr<::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>> target_)
+        RapServerAdapter(std::unique_ptr<RAP::Transport::ISyncWireTransport> transport_, std::shared_ptr<::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>> target_, InterruptPolicy interrupt_policy_ = {})
             : transport(std::move(transport_))
             , target(std::move(target_))
             , serdes(this->transport->getMaxMessageSize())
+            , rx_buffer(this->transport->getMaxMessageSize())
+            , tx_pool(this->transport->getMaxMessageSize(), 2)
+            , interrupt_policy(interrupt_policy_)
             , worker([this] { this->backgroundWork(); })
-        {}
+        {
+            if constexpr (Cfg::FeatureInterrupt) {
+                this->interrupt_worker = std::jthread([this](std::stop_token stoken) { this->interruptWork(stoken); });
+            }
+        }
+
+        // Raise an interrupt towards the client.
+        // Status bits of interrupts raised while one is pending are OR'd together and sent as one message,
+        // subject to the coalescing window and rate limit of the InterruptPolicy.  Safe to call from any thread.
+        void raiseInterrupt(typename Cfg::DataType status) requires Cfg::FeatureInterrupt
+        {
+            {
+                std::lock_guard lg{ this->interrupt_mtx };
+                if (!this->interrupt_pending) {
+                    this->interrupt_pending = true;
+                    this->interrupt_first_raised = std::chrono::steady_clock::now();
+                }
+                this->interrupt_status |= status;
+            }
+            this->interrupt_cv.notify_one();
+        }
+        void setInterruptPolicy(InterruptPolicy policy)
+        {
+            {
+                std::lock_guard lg{ this->interrupt_mtx };
+                this->interrupt_policy = policy;
+            }
+            this->interrupt_cv.notify_one();
+        }
+        // Commands served, with the time the register target took for each, NAKs sent and commands dropped.
+        TargetStats const& getStats() const { return this->stats; }
 
     private:
         Serdes::ReadSingleAckResponse<Cfg> handleCmd(Serdes::ReadSingleCommand<Cfg> const& cmd)
@@ -78,39 +123,130 @@ namespace RAP::RTF {
         void backgroundWork()
         {
             while (!this->worker.get_stop_token().stop_requested()) {
-                auto const cmd_buf = this->transport->recv(this->worker.get_stop_token());
+                size_t cmd_size = 0;
+                try {
+                    cmd_size = this->transport->recv(this->rx_buffer, this->worker.get_stop_token());
+                }
+                catch (Transport::TransportTimeoutException const&) {
+                    // The client has simply been idle.
+                    continue;
+                }
+                catch (Transport::TransportClosedException const&) {
+                    // The client went away; nothing more will arrive on this transport.
+                    return;
+                }
                 if (this->worker.get_stop_token().stop_requested())
                     return;
-                auto const cmd = this->serdes.decodeCommand(cmd_buf);
+                Serdes::Command<Cfg> cmd;
+                try {
+                    cmd = this->serdes.decodeCommand(BufferView{ this->rx_buffer }.first(cmd_size));
+                }
+                catch (CrcMismatchException const&) {
+                    // A corrupted or malformed command is dropped, as a device would; the client times out.
+                    this->stats.recordCrcFailure();
+                    continue;
+                }
+                catch (RAP::Exception const&) {
+                    this->stats.recordMalformed();
+                    continue;
+                }
                 auto const resp = std::visit([&](auto&& cmd) -> Serdes::Response<Cfg> {
                     using T = std::decay_t<decltype(cmd)>;
+                    auto const kind = operationKindOf<Cfg>(cmd);
+                    TargetStats::InFlight const in_flight{ this->stats };
+                    auto const started = std::chrono::steady_clock::now();
                     try {
-                        return this->handleCmd(cmd);
+                        auto resp = this->handleCmd(cmd);
+                        this->stats.recordCompletion(kind, std::chrono::steady_clock::now() - started);
+                        return resp;
                     }
                     catch (std::exception const& ex) {
                         //LOG_ERROR(this, "Error while processing command: {}", ex.what());
-                        return typename RAP::Serdes::CommandResponseRelationshipTrait<T>::NakResponseType{
-                            .transaction_id = cmd.transaction_id,
-                            .status = 0xFD,
-                        };
                     }
                     catch (...) {
-                        return typename RAP::Serdes::CommandResponseRelationshipTrait<T>::NakResponseType{
-                            .transaction_id = cmd.transaction_id,
-                            .status = 0xFD,
-                        };
                     }
+                    this->stats.recordCompletion(kind, std::chrono::steady_clock::now() - started);
+                    this->stats.recordError(kind);
+                    this->stats.recordNak(0xFD);
+                    return typename RAP::Serdes::CommandResponseRelationshipTrait<T>::NakResponseType{
+                        .transaction_id = cmd.transaction_id,
+                        .status = 0xFD,
+                    };
+                }, cmd);
+                // Posted commands are never answered, even when they fail.
+                auto const posted = std::visit([](auto const& cmd) {
+                    if constexpr (requires { cmd.posted; })
+                        return cmd.posted;
+                    else
+                        return false;
                 }, cmd);
-                auto const resp_buf = this->serdes.encodeResponse(resp);
-                this->transport->send(resp_buf);
+                if (posted)
+                    continue;
+                auto resp_buf = this->tx_pool.lease();
+                this->serdes.encodeResponse(resp, *resp_buf);
+                this->send(*resp_buf);
+            }
+        }
+        void interruptWork(std::stop_token stoken)
+        {
+            std::unique_lock lk{ this->interrupt_mtx };
+            while (!stoken.stop_requested()) {
+                this->interrupt_cv.wait(lk, stoken, [&] { return this->interrupt_pending; });
+                if (stoken.stop_requested())
+                    return;
+                // Hold the interrupt until both the coalescing window and the rate limit allow it out.
+                // Interrupts raised meanwhile are merged into interrupt_status.
+                auto const send_at = std::max(
+                    this->interrupt_first_raised + this->interrupt_policy.coalesce_window,
+                    this->interrupt_last_sent + this->interrupt_policy.min_interval);
+                this->interrupt_cv.wait_until(lk, stoken, send_at, [&] { return std::chrono::steady_clock::now() >= send_at; });
+                if (stoken.stop_requested())
+                    return;
+                auto const irq = Serdes::Interrupt<Cfg>{
+                    .transaction_id = this->interrupt_txn_id++,
+                    .status = std::exchange(this->interrupt_status, typename Cfg::DataType{ 0 }),
+                };
+                this->interrupt_pending = false;
+                this->interrupt_last_sent = std::chrono::steady_clock::now();
+                lk.unlock();
+                try {
+                    auto irq_buf = this->tx_pool.lease();
+                    this->serdes.encodeResponse(irq, *irq_buf);
+                    this->send(*irq_buf);
+                }
+                catch (std::exception const& ex) {
+                    //LOG_ERROR(this, "Error while sending interrupt: {}", ex.what());
+                }
+                lk.lock();
             }
         }
+        void send(BufferView buffer)
+        {
+            // Responses and interrupts are sent from different threads.
+            std::lock_guard lg{ this->send_mtx };
+            this->transport->send(buffer);
+        }
 
 private:
     std::unique_ptr<Transport::ISyncWireTransport> transport;
     std::shared_ptr<::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>> target;
     Serdes::Serdes<Cfg> serdes;
+    // Commands are received into rx_buffer; responses and interrupts are encoded into buffers from tx_pool,
+    // so serving a single-register command does not allocate.
+    Buffer rx_buffer;
+    BufferPool tx_pool;
+    std::mutex send_mtx;
+    std::mutex interrupt_mtx;
+    std::condition_variable_any interrupt_cv;
+    InterruptPolicy interrupt_policy;
+    bool interrupt_pending = false;
+    typename Cfg::DataType interrupt_status{ 0 };
+    uint8_t interrupt_txn_id = 0;
+    std::chrono::steady_clock::time_point interrupt_first_raised{};
+    std::chrono::steady_clock::time_point interrupt_last_sent{};
+    TargetStats stats;
     std::jthread worker;
+    std::jthread interrupt_worker;
 };
 
 }
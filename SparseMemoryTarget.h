@@ -0,0 +1,269 @@
+#pragma once
+#include "Configuration.h"
+#include "Types.h"
+#include <RTF/RTF.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <vector>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace RAP::RTF {
+
+struct SparseMemoryOptions {
+    // Each page holds (1 << page_bits) registers.
+    uint8_t page_bits = 12;
+    // Back pages with (transparent) huge pages where the platform supports it.
+    // Only useful when a page is at least as large as a huge page (e.g. page_bits >= 19 for 32-bit data).
+    bool hugepages = false;
+};
+
+// An in-memory register file covering the full address space of Cfg.
+// Storage is a two-level page table whose pages are allocated lazily on first write;
+// reads of never-written registers return 0 without allocating.
+// Page allocation is lock-free, so disjoint address ranges may be accessed from multiple threads.
+template <IsConfigurationType Cfg>
+class SparseMemoryRegisterTarget : public ::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>
+{
+public:
+    using AddressType = typename Cfg::AddressType;
+    using DataType = typename Cfg::DataType;
+private:
+    static constexpr size_t word_shift = std::countr_zero(sizeof(DataType));
+    static constexpr size_t max_l1_bits = 24;
+public:
+    SparseMemoryRegisterTarget(std::string_view name, SparseMemoryOptions options = {})
+        : ::RTF::IRegisterTarget<typename Cfg::AddressType, typename Cfg::DataType>(name)
+        , page_bits(options.page_bits)
+        , hugepages(options.hugepages)
+    {
+        size_t const index_bits = (Cfg::AddressBits > word_shift) ? (Cfg::AddressBits - word_shift) : 0;
+        if (this->page_bits > index_bits)
+            this->page_bits = static_cast<uint8_t>(index_bits);
+        size_t const table_bits = index_bits - this->page_bits;
+        this->l2_bits = std::min<size_t>(table_bits, 16);
+        size_t const l1_bits = table_bits - this->l2_bits;
+        if (l1_bits > max_l1_bits)
+            throw Exception("SparseMemoryRegisterTarget: address space too large; increase page_bits");
+        this->l1 = std::make_unique<std::atomic<L2Table*>[]>(size_t{ 1 } << l1_bits);
+    }
+    ~SparseMemoryRegisterTarget()
+    {
+        size_t const l1_size = this->l1Size();
+        size_t const l2_size = size_t{ 1 } << this->l2_bits;
+        for (size_t i = 0; i < l1_size; i++) {
+            auto* const l2 = this->l1[i].load(std::memory_order_relaxed);
+            if (!l2)
+                continue;
+            for (size_t j = 0; j < l2_size; j++) {
+                if (auto* const page = l2->pages[j].load(std::memory_order_relaxed))
+                    this->freePage(page);
+            }
+            delete l2;
+        }
+    }
+    SparseMemoryRegisterTarget(SparseMemoryRegisterTarget const&) = delete;
+    SparseMemoryRegisterTarget& operator=(SparseMemoryRegisterTarget const&) = delete;
+
+    virtual std::string_view getDomain() const { return "SparseMemoryRegisterTarget"; }
+
+    virtual void write(AddressType addr, DataType data) override
+    {
+        auto const idx = this->wordIndex(addr);
+        this->pageForWrite(idx)[this->pageOffset(idx)] = data;
+    }
+    [[nodiscard]] virtual DataType read(AddressType addr) override
+    {
+        auto const idx = this->wordIndex(addr);
+        auto const* const page = this->pageForRead(idx);
+        return page ? page[this->pageOffset(idx)] : DataType{ 0 };
+    }
+    virtual void readModifyWrite(AddressType addr, DataType new_data, DataType mask) override
+    {
+        auto const idx = this->wordIndex(addr);
+        auto& reg = this->pageForWrite(idx)[this->pageOffset(idx)];
+        reg = (reg & ~mask) | (new_data & mask);
+    }
+
+    virtual void seqWrite(AddressType start_addr, std::span<DataType const> data, size_t increment = sizeof(DataType)) override
+    {
+        if (increment == 0)
+            return this->fifoWrite(start_addr, data);
+        if (increment != sizeof(DataType))
+            return this->IRegisterTarget::seqWrite(start_addr, data, increment);
+        size_t idx = this->wordIndex(start_addr);
+        while (!data.empty()) {
+            auto const n = std::min(data.size(), this->pageWords() - this->pageOffset(idx));
+            std::memcpy(this->pageForWrite(idx) + this->pageOffset(idx), data.data(), n * sizeof(DataType));
+            data = data.subspan(n);
+            idx = this->nextIndex(idx, n);
+        }
+    }
+    virtual void seqRead(AddressType start_addr, std::span<DataType> out_data, size_t increment = sizeof(DataType)) override
+    {
+        if (increment == 0)
+            return this->fifoRead(start_addr, out_data);
+        if (increment != sizeof(DataType))
+            return this->IRegisterTarget::seqRead(start_addr, out_data, increment);
+        size_t idx = this->wordIndex(start_addr);
+        while (!out_data.empty()) {
+            auto const n = std::min(out_data.size(), this->pageWords() - this->pageOffset(idx));
+            if (auto const* const page = this->pageForRead(idx))
+                std::memcpy(out_data.data(), page + this->pageOffset(idx), n * sizeof(DataType));
+            else
+                std::fill_n(out_data.begin(), n, DataType{ 0 });
+            out_data = out_data.subspan(n);
+            idx = this->nextIndex(idx, n);
+        }
+    }
+
+    virtual void fifoWrite(AddressType fifo_addr, std::span<DataType const> data) override
+    {
+        // A memory has no FIFO semantics; the last value written wins.
+        if (data.empty())
+            return;
+        this->write(fifo_addr, data.back());
+    }
+    virtual void fifoRead(AddressType fifo_addr, std::span<DataType> out_data) override
+    {
+        std::fill(out_data.begin(), out_data.end(), this->read(fifo_addr));
+    }
+
+    virtual void compWrite(std::span<std::pair<AddressType, DataType> const> addr_data) override
+    {
+        size_t cached_page_no = ~size_t{ 0 };
+        DataType* page = nullptr;
+        for (auto const& [addr, data] : addr_data) {
+            auto const idx = this->wordIndex(addr);
+            if ((idx >> this->page_bits) != cached_page_no) {
+                cached_page_no = idx >> this->page_bits;
+                page = this->pageForWrite(idx);
+            }
+            page[this->pageOffset(idx)] = data;
+        }
+    }
+    virtual void compRead(std::span<AddressType const> const addresses, std::span<DataType> out_data) override
+    {
+        assert(addresses.size() == out_data.size());
+        size_t cached_page_no = ~size_t{ 0 };
+        DataType const* page = nullptr;
+        for (size_t i = 0; i < addresses.size(); i++) {
+            auto const idx = this->wordIndex(addresses[i]);
+            if ((idx >> this->page_bits) != cached_page_no) {
+                cached_page_no = idx >> this->page_bits;
+                page = this->pageForRead(idx);
+            }
+            out_data[i] = page ? page[this->pageOffset(idx)] : DataType{ 0 };
+        }
+    }
+
+    // Number of pages currently backed by memory.
+    size_t getAllocatedPageCount() const
+    {
+        return this->allocated_pages.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct L2Table {
+        explicit L2Table(size_t size) : pages(std::make_unique<std::atomic<DataType*>[]>(size)) {}
+        std::unique_ptr<std::atomic<DataType*>[]> pages;
+    };
+
+    size_t wordIndex(AddressType addr) const
+    {
+        auto const masked = static_cast<uint64_t>(addr) & this->addressMask();
+        return static_cast<size_t>(masked >> word_shift);
+    }
+    size_t nextIndex(size_t idx, size_t n) const
+    {
+        // Wrap at the end of the address space like the hardware would.
+        return (idx + n) & (this->addressMask() >> word_shift);
+    }
+    static constexpr uint64_t addressMask()
+    {
+        if constexpr (Cfg::AddressBits >= 64)
+            return ~uint64_t{ 0 };
+        else
+            return (uint64_t{ 1 } << Cfg::AddressBits) - 1;
+    }
+    size_t pageWords() const { return size_t{ 1 } << this->page_bits; }
+    size_t pageOffset(size_t idx) const { return idx & (this->pageWords() - 1); }
+    size_t l1Size() const
+    {
+        size_t const index_bits = (Cfg::AddressBits > word_shift) ? (Cfg::AddressBits - word_shift) : 0;
+        return size_t{ 1 } << (index_bits - this->page_bits - this->l2_bits);
+    }
+
+    DataType const* pageForRead(size_t idx) const
+    {
+        size_t const page_no = idx >> this->page_bits;
+        auto const* const l2 = this->l1[page_no >> this->l2_bits].load(std::memory_order_acquire);
+        if (!l2)
+            return nullptr;
+        return l2->pages[page_no & ((size_t{ 1 } << this->l2_bits) - 1)].load(std::memory_order_acquire);
+    }
+    DataType* pageForWrite(size_t idx)
+    {
+        size_t const page_no = idx >> this->page_bits;
+        auto& l1_slot = this->l1[page_no >> this->l2_bits];
+        auto* l2 = l1_slot.load(std::memory_order_acquire);
+        if (!l2) {
+            auto* const new_l2 = new L2Table(size_t{ 1 } << this->l2_bits);
+            if (l1_slot.compare_exchange_strong(l2, new_l2, std::memory_order_acq_rel))
+                l2 = new_l2;
+            else
+                delete new_l2;
+        }
+        auto& l2_slot = l2->pages[page_no & ((size_t{ 1 } << this->l2_bits) - 1)];
+        auto* page = l2_slot.load(std::memory_order_acquire);
+        if (!page) {
+            auto* const new_page = this->allocPage();
+            if (l2_slot.compare_exchange_strong(page, new_page, std::memory_order_acq_rel)) {
+                page = new_page;
+                this->allocated_pages.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                this->freePage(new_page);
+            }
+        }
+        return page;
+    }
+
+    DataType* allocPage() const
+    {
+        size_t const bytes = this->pageWords() * sizeof(DataType);
+#if defined(__linux__)
+        // Anonymous mappings are zero-filled by the kernel on first touch.
+        void* const p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+        if (this->hugepages)
+            ::madvise(p, bytes, MADV_HUGEPAGE);
+        return static_cast<DataType*>(p);
+#else
+        return new DataType[this->pageWords()]();
+#endif
+    }
+    void freePage(DataType* page) const
+    {
+#if defined(__linux__)
+        ::munmap(page, this->pageWords() * sizeof(DataType));
+#else
+        delete[] page;
+#endif
+    }
+
+private:
+    uint8_t page_bits;
+    size_t l2_bits;
+    bool hugepages;
+    std::unique_ptr<std::atomic<L2Table*>[]> l1;
+    std::atomic<size_t> allocated_pages{ 0 };
+};
+
+}
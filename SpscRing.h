@@ -0,0 +1,194 @@
+#pragma once
+#include "Transports.h"
+#include "Types.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <span>
+#include <stop_token>
+#include <thread>
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace RAP::Transport {
+
+inline void cpuRelax()
+{
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Control block of an SpscRing; placed at the start of the ring's memory, followed by the slots.
+// It contains only lock-free atomics, so the ring may live in memory shared between processes.
+struct SpscRingControl {
+    // Next message to be written; only written by the producer.
+    alignas(64) std::atomic<uint64_t> head;
+    // Next message to be read; only written by the consumer.
+    alignas(64) std::atomic<uint64_t> tail;
+    // Set while the consumer (producer) is parked waiting for data (space).
+    alignas(64) std::atomic<uint32_t> consumer_parked;
+    std::atomic<uint32_t> producer_parked;
+    // Bumped to wake a parked consumer (producer); usable as a futex word.
+    std::atomic<uint32_t> data_seq;
+    std::atomic<uint32_t> space_seq;
+};
+
+// Parks a thread on a condition variable, for rings used within one process.
+// The mutex is only taken by the waking side when the other side has actually parked.
+class CvParker
+{
+public:
+    CvParker(std::atomic<uint32_t>& parked_, std::atomic<uint32_t>& /*seq*/) : parked(parked_) {}
+
+    template <typename Ready>
+    bool wait(Ready&& ready, std::chrono::steady_clock::time_point deadline, std::stop_token stoken)
+    {
+        std::unique_lock lk{ this->mtx };
+        this->parked.store(1, std::memory_order_relaxed);
+        // Pairs with the fence in wake(): either this side sees the new state, or that side sees `parked`.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto const ok = this->cv.wait_until(lk, stoken, deadline, ready);
+        this->parked.store(0, std::memory_order_relaxed);
+        return ok;
+    }
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (this->parked.load(std::memory_order_relaxed)) {
+            { std::lock_guard lg{ this->mtx }; }
+            this->cv.notify_one();
+        }
+    }
+
+private:
+    std::atomic<uint32_t>& parked;
+    std::mutex mtx;
+    std::condition_variable_any cv;
+};
+
+// Spinning only helps when the other side runs on another CPU.
+inline uint32_t defaultSpinBudget()
+{
+    return std::thread::hardware_concurrency() > 1 ? 4096 : 0;
+}
+
+// Lock-free single-producer/single-consumer ring of fixed-size message slots over caller-provided memory.
+// Waiting sides spin for `spin_budget` iterations before parking with the Parker.
+// push() must only be called from one thread at a time, and likewise pop().
+template <typename Parker>
+class SpscRing
+{
+public:
+    static size_t slotBytes(size_t max_message_size)
+    {
+        return (sizeof(uint32_t) + max_message_size + 63) & ~size_t{ 63 };
+    }
+    static size_t requiredBytes(uint32_t slot_count, size_t max_message_size)
+    {
+        return sizeof(SpscRingControl) + slot_count * slotBytes(max_message_size);
+    }
+
+    // `memory` must be 64-byte aligned and hold requiredBytes(slot_count, max_message_size) bytes.
+    // `slot_count` must be a power of two.  Exactly one side constructs the ring with `initialize` set.
+    SpscRing(void* memory, uint32_t slot_count_, size_t max_message_size_, bool initialize, uint32_t spin_budget_ = defaultSpinBudget())
+        : control(initialize ? new (memory) SpscRingControl{} : std::launder(static_cast<SpscRingControl*>(memory)))
+        , slots(static_cast<uint8_t*>(memory) + sizeof(SpscRingControl))
+        , slot_count(slot_count_)
+        , slot_bytes(slotBytes(max_message_size_))
+        , max_message_size(max_message_size_)
+        , spin_budget(spin_budget_)
+        , data_parker(this->control->consumer_parked, this->control->data_seq)
+        , space_parker(this->control->producer_parked, this->control->space_seq)
+    {
+        if (this->slot_count == 0 || (this->slot_count & (this->slot_count - 1)) != 0)
+            throw Exception("SpscRing slot_count must be a power of two");
+    }
+    SpscRing(SpscRing const&) = delete;
+    SpscRing& operator=(SpscRing const&) = delete;
+
+    // Copies a message into the next slot, waiting up to `timeout` for one to become free.
+    void push(BufferView message, std::chrono::microseconds timeout)
+    {
+        if (message.size() > this->max_message_size)
+            throw MessageSizeException("Message exceeds the ring's slot size");
+        auto const head = this->control->head.load(std::memory_order_relaxed);
+        auto const has_space = [&] {
+            return head - this->control->tail.load(std::memory_order_acquire) < this->slot_count;
+        };
+        if (!this->waitFor(has_space, this->space_parker, timeout, {}))
+            throw TransportTimeoutException();
+        auto* const slot = this->slot(head);
+        uint32_t const size = static_cast<uint32_t>(message.size());
+        std::memcpy(slot, &size, sizeof(size));
+        std::memcpy(slot + sizeof(size), message.data(), message.size());
+        this->control->head.store(head + 1, std::memory_order_release);
+        this->data_parker.wake();
+    }
+    // Waits up to `timeout` for a message and passes it, in place, to `fn(BufferView)`; the slot is freed afterwards,
+    // even if `fn` throws, so a message the caller cannot take (e.g. too large for its buffer) is dropped rather than
+    // blocking the ring.  Returns false if `stoken` was signalled.
+    template <typename Fn>
+    bool pop(Fn&& fn, std::chrono::microseconds timeout, std::stop_token stoken = {})
+    {
+        auto const tail = this->control->tail.load(std::memory_order_relaxed);
+        auto const has_data = [&] {
+            return this->control->head.load(std::memory_order_acquire) != tail;
+        };
+        if (!this->waitFor(has_data, this->data_parker, timeout, stoken)) {
+            if (stoken.stop_requested())
+                return false;
+            throw TransportTimeoutException();
+        }
+        struct Release {
+            SpscRing& ring;
+            uint64_t tail;
+            ~Release()
+            {
+                this->ring.control->tail.store(this->tail + 1, std::memory_order_release);
+                this->ring.space_parker.wake();
+            }
+        } const release{ *this, tail };
+        auto const* const slot = this->slot(tail);
+        uint32_t size;
+        std::memcpy(&size, slot, sizeof(size));
+        fn(BufferView{ slot + sizeof(size), size });
+        return true;
+    }
+    size_t getMaxMessageSize() const { return this->max_message_size; }
+
+private:
+    uint8_t* slot(uint64_t index) const
+    {
+        return this->slots + (index & (this->slot_count - 1)) * this->slot_bytes;
+    }
+    template <typename Ready>
+    bool waitFor(Ready const& ready, Parker& parker, std::chrono::microseconds timeout, std::stop_token stoken)
+    {
+        for (uint32_t i = 0; i < this->spin_budget; i++) {
+            if (ready())
+                return true;
+            cpuRelax();
+        }
+        if (ready())
+            return true;
+        return parker.wait(ready, std::chrono::steady_clock::now() + timeout, stoken);
+    }
+
+    SpscRingControl* control;
+    uint8_t* slots;
+    uint32_t slot_count;
+    size_t slot_bytes;
+    size_t max_message_size;
+    uint32_t spin_budget;
+    Parker data_parker;
+    Parker space_parker;
+};
+
+}
@@ -0,0 +1,468 @@
+#pragma once
+#include "Types.h"
+#include "Configuration.h"
+#include "Serdes.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <format>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace RAP {
+
+enum class OperationKind : uint8_t {
+    eRead,
+    eWrite,
+    eReadModifyWrite,
+    eSeqRead,
+    eSeqWrite,
+    eFifoRead,
+    eFifoWrite,
+    eCompRead,
+    eCompWrite,
+};
+inline constexpr size_t operation_kind_count = 9;
+
+constexpr std::string_view operationKindName(OperationKind kind)
+{
+    switch (kind) {
+        case OperationKind::eRead: return "read";
+        case OperationKind::eWrite: return "write";
+        case OperationKind::eReadModifyWrite: return "read_modify_write";
+        case OperationKind::eSeqRead: return "seq_read";
+        case OperationKind::eSeqWrite: return "seq_write";
+        case OperationKind::eFifoRead: return "fifo_read";
+        case OperationKind::eFifoWrite: return "fifo_write";
+        case OperationKind::eCompRead: return "comp_read";
+        case OperationKind::eCompWrite: return "comp_write";
+    }
+    return "unknown";
+}
+
+// The kind of operation a command carries out; sequential commands with an increment of 0 are FIFO accesses.
+template <IsConfigurationType Cfg, typename CmdType>
+constexpr OperationKind operationKindOf(CmdType const& cmd)
+{
+    if constexpr (std::is_same_v<CmdType, Serdes::ReadSingleCommand<Cfg>>)
+        return OperationKind::eRead;
+    else if constexpr (std::is_same_v<CmdType, Serdes::WriteSingleCommand<Cfg>>)
+        return OperationKind::eWrite;
+    else if constexpr (std::is_same_v<CmdType, Serdes::ReadModifyWriteCommand<Cfg>>)
+        return OperationKind::eReadModifyWrite;
+    else if constexpr (std::is_same_v<CmdType, Serdes::ReadSeqCommand<Cfg>>)
+        return cmd.increment == 0 ? OperationKind::eFifoRead : OperationKind::eSeqRead;
+    else if constexpr (std::is_same_v<CmdType, Serdes::WriteSeqCommand<Cfg>>)
+        return cmd.increment == 0 ? OperationKind::eFifoWrite : OperationKind::eSeqWrite;
+    else if constexpr (std::is_same_v<CmdType, Serdes::ReadCompCommand<Cfg>>)
+        return OperationKind::eCompRead;
+    else
+        return OperationKind::eCompWrite;
+}
+
+constexpr std::string_view messageTypeName(uint8_t type)
+{
+    using Serdes::MessageType;
+    switch (static_cast<MessageType>(type)) {
+        case MessageType::eCmdSingleRead: return "CmdSingleRead";
+        case MessageType::eAckSingleRead: return "AckSingleRead";
+        case MessageType::eNakSingleRead: return "NakSingleRead";
+        case MessageType::eCmdSingleWrite: return "CmdSingleWrite";
+        case MessageType::eCmdSingleWritePosted: return "CmdSingleWritePosted";
+        case MessageType::eAckSingleWrite: return "AckSingleWrite";
+        case MessageType::eNakSingleWrite: return "NakSingleWrite";
+        case MessageType::eCmdSeqRead: return "CmdSeqRead";
+        case MessageType::eAckSeqRead: return "AckSeqRead";
+        case MessageType::eNakSeqRead: return "NakSeqRead";
+        case MessageType::eCmdSeqWrite: return "CmdSeqWrite";
+        case MessageType::eCmdSeqWritePosted: return "CmdSeqWritePosted";
+        case MessageType::eAckSeqWrite: return "AckSeqWrite";
+        case MessageType::eNakSeqWrite: return "NakSeqWrite";
+        case MessageType::eCmdCompRead: return "CmdCompRead";
+        case MessageType::eAckCompRead: return "AckCompRead";
+        case MessageType::eNakCompRead: return "NakCompRead";
+        case MessageType::eCmdCompWrite: return "CmdCompWrite";
+        case MessageType::eCmdCompWritePosted: return "CmdCompWritePosted";
+        case MessageType::eAckCompWrite: return "AckCompWrite";
+        case MessageType::eNakCompWrite: return "NakCompWrite";
+        case MessageType::eCmdSingleRmw: return "CmdSingleRmw";
+        case MessageType::eCmdSingleRmwPosted: return "CmdSingleRmwPosted";
+        case MessageType::eAckSingleRmw: return "AckSingleRmw";
+        case MessageType::eNakSingleRmw: return "NakSingleRmw";
+        case MessageType::eAckSingleInterrupt: return "AckSingleInterrupt";
+    }
+    return "unknown";
+}
+
+// Lock-free latency histogram in the style of HdrHistogram: every power of two is split into 8 linear buckets,
+// so a recorded value is known to within 12.5% from 8 ns up to about a minute, in a fixed 272 buckets.
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned sub_bucket_bits = 3;
+    static constexpr size_t sub_buckets = size_t{ 1 } << sub_bucket_bits;
+    // Values of 2^36 ns (about 69 s) or more all fall in the last bucket.
+    static constexpr unsigned max_magnitude = 36;
+    static constexpr size_t bucket_count = (max_magnitude - sub_bucket_bits + 1) * sub_buckets;
+
+    struct Snapshot {
+        uint64_t count = 0;
+        uint64_t sum_ns = 0;
+        uint64_t min_ns = 0;
+        uint64_t max_ns = 0;
+        std::array<uint64_t, bucket_count> buckets{};
+
+        double meanNs() const
+        {
+            return this->count != 0 ? static_cast<double>(this->sum_ns) / static_cast<double>(this->count) : 0.0;
+        }
+        // The value below which `percent` of the samples fall, rounded up to the end of its bucket.
+        uint64_t percentileNs(double percent) const
+        {
+            if (this->count == 0)
+                return 0;
+            auto const wanted = std::max<uint64_t>(1, static_cast<uint64_t>(percent / 100.0 * static_cast<double>(this->count) + 0.5));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < bucket_count; i++) {
+                seen += this->buckets[i];
+                if (seen >= wanted)
+                    return std::clamp(bucketUpperBound(i), this->min_ns, this->max_ns);
+            }
+            return this->max_ns;
+        }
+    };
+
+    void record(std::chrono::nanoseconds latency)
+    {
+        auto const ns = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+        this->buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+        this->count.fetch_add(1, std::memory_order_relaxed);
+        this->sum_ns.fetch_add(ns, std::memory_order_relaxed);
+        auto current = this->min_ns.load(std::memory_order_relaxed);
+        while (ns < current && !this->min_ns.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+        }
+        current = this->max_ns.load(std::memory_order_relaxed);
+        while (ns > current && !this->max_ns.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+        }
+    }
+    // Samples recorded while the snapshot is taken may be only partly included.
+    Snapshot snapshot() const
+    {
+        Snapshot s;
+        s.count = this->count.load(std::memory_order_relaxed);
+        s.sum_ns = this->sum_ns.load(std::memory_order_relaxed);
+        s.min_ns = s.count != 0 ? this->min_ns.load(std::memory_order_relaxed) : 0;
+        s.max_ns = this->max_ns.load(std::memory_order_relaxed);
+        // A sample being recorded may have been counted before its min/max update landed.
+        s.min_ns = std::min(s.min_ns, s.max_ns);
+        for (size_t i = 0; i < bucket_count; i++)
+            s.buckets[i] = this->buckets[i].load(std::memory_order_relaxed);
+        return s;
+    }
+
+    static constexpr size_t bucketIndex(uint64_t ns)
+    {
+        if (ns < sub_buckets)
+            return static_cast<size_t>(ns);
+        auto const magnitude = static_cast<unsigned>(std::bit_width(ns)) - 1;
+        if (magnitude >= max_magnitude)
+            return bucket_count - 1;
+        auto const shift = magnitude - sub_bucket_bits;
+        return (shift + 1) * sub_buckets + static_cast<size_t>((ns >> shift) & (sub_buckets - 1));
+    }
+    static constexpr uint64_t bucketUpperBound(size_t index)
+    {
+        if (index < sub_buckets)
+            return index;
+        auto const shift = index / sub_buckets - 1;
+        auto const lower = (sub_buckets + index % sub_buckets) << shift;
+        return lower + (uint64_t{ 1 } << shift) - 1;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<uint64_t> sum_ns{ 0 };
+    std::atomic<uint64_t> min_ns{ std::numeric_limits<uint64_t>::max() };
+    std::atomic<uint64_t> max_ns{ 0 };
+};
+
+namespace detail {
+
+inline std::string formatNs(uint64_t ns)
+{
+    if (ns < 10'000)
+        return std::format("{}ns", ns);
+    if (ns < 10'000'000)
+        return std::format("{:.1f}us", ns / 1e3);
+    if (ns < 10'000'000'000)
+        return std::format("{:.1f}ms", ns / 1e6);
+    return std::format("{:.1f}s", ns / 1e9);
+}
+inline std::string histogramText(LatencyHistogram::Snapshot const& h)
+{
+    return std::format("min={} p50={} p90={} p99={} p99.9={} max={}",
+        formatNs(h.min_ns), formatNs(h.percentileNs(50)), formatNs(h.percentileNs(90)), formatNs(h.percentileNs(99)), formatNs(h.percentileNs(99.9)), formatNs(h.max_ns));
+}
+inline std::string histogramJson(LatencyHistogram::Snapshot const& h)
+{
+    return std::format(R"({{"count":{},"min_ns":{},"mean_ns":{:.0f},"p50_ns":{},"p90_ns":{},"p99_ns":{},"p999_ns":{},"max_ns":{}}})",
+        h.count, h.min_ns, h.meanNs(), h.percentileNs(50), h.percentileNs(90), h.percentileNs(99), h.percentileNs(99.9), h.max_ns);
+}
+
+}
+
+// Counters kept by RapRegisterTarget, AsyncRapRegisterTarget and RapServerAdapter.  Updating them is lock-free,
+// so they are always on; snapshot() copies them for reporting.
+// On the client side an operation is one command, and its latency runs from sending it to receiving its response,
+// including any retries.  On the server side an operation is one command served, and its latency is the time taken
+// by the register target; its errors are the NAKs sent.
+class TargetStats
+{
+public:
+    // NAK statuses are counted individually for the first this many distinct values seen, then together.
+    static constexpr size_t nak_status_slots = 16;
+
+    struct OperationSnapshot {
+        uint64_t count = 0;
+        uint64_t errors = 0;
+        LatencyHistogram::Snapshot latency;
+    };
+    struct Snapshot {
+        std::array<OperationSnapshot, operation_kind_count> operations{};
+        // (status, count), in the order the statuses were first seen.
+        std::vector<std::pair<uint32_t, uint64_t>> naks;
+        uint64_t naks_other = 0;
+        uint64_t crc_failures = 0;
+        uint64_t malformed = 0;
+        uint64_t timeouts = 0;
+        uint64_t retries = 0;
+        uint64_t stale_responses = 0;
+        uint64_t in_flight = 0;
+        uint64_t max_in_flight = 0;
+
+        std::string toText() const
+        {
+            std::string text;
+            for (size_t i = 0; i < operation_kind_count; i++) {
+                auto const& op = this->operations[i];
+                if (op.count == 0 && op.errors == 0)
+                    continue;
+                text += std::format("{}: {} ops, {} errors, {}\n", operationKindName(static_cast<OperationKind>(i)), op.count, op.errors, detail::histogramText(op.latency));
+            }
+            if (!this->naks.empty() || this->naks_other != 0) {
+                text += "naks:";
+                for (auto const& [status, count] : this->naks)
+                    text += std::format(" 0x{:X}={}", status, count);
+                if (this->naks_other != 0)
+                    text += std::format(" other={}", this->naks_other);
+                text += "\n";
+            }
+            text += std::format("crc_failures={} malformed={} timeouts={} retries={} stale_responses={} in_flight={} max_in_flight={}\n",
+                this->crc_failures, this->malformed, this->timeouts, this->retries, this->stale_responses, this->in_flight, this->max_in_flight);
+            return text;
+        }
+        std::string toJson() const
+        {
+            std::string json = R"({"operations":{)";
+            for (size_t i = 0; i < operation_kind_count; i++) {
+                auto const& op = this->operations[i];
+                json += std::format(R"({}"{}":{{"count":{},"errors":{},"latency":{}}})", i == 0 ? "" : ",",
+                    operationKindName(static_cast<OperationKind>(i)), op.count, op.errors, detail::histogramJson(op.latency));
+            }
+            json += R"(},"naks":{)";
+            for (size_t i = 0; i < this->naks.size(); i++)
+                json += std::format(R"({}"{}":{})", i == 0 ? "" : ",", this->naks[i].first, this->naks[i].second);
+            json += std::format(R"(}},"naks_other":{},"crc_failures":{},"malformed":{},"timeouts":{},"retries":{},"stale_responses":{},"in_flight":{},"max_in_flight":{}}})",
+                this->naks_other, this->crc_failures, this->malformed, this->timeouts, this->retries, this->stale_responses, this->in_flight, this->max_in_flight);
+            return json;
+        }
+    };
+
+    // Counts an operation as in flight for the guard's lifetime.
+    class InFlight
+    {
+    public:
+        explicit InFlight(TargetStats& stats_) : stats(stats_)
+        {
+            auto const depth = this->stats.in_flight.fetch_add(1, std::memory_order_relaxed) + 1;
+            auto current = this->stats.max_in_flight.load(std::memory_order_relaxed);
+            while (depth > current && !this->stats.max_in_flight.compare_exchange_weak(current, depth, std::memory_order_relaxed)) {
+            }
+        }
+        ~InFlight() { this->stats.in_flight.fetch_sub(1, std::memory_order_relaxed); }
+        InFlight(InFlight const&) = delete;
+        InFlight& operator=(InFlight const&) = delete;
+    private:
+        TargetStats& stats;
+    };
+
+    // An operation got its response (ACK or NAK) after `latency`.
+    void recordCompletion(OperationKind kind, std::chrono::nanoseconds latency)
+    {
+        auto& op = this->operations[static_cast<size_t>(kind)];
+        op.count.fetch_add(1, std::memory_order_relaxed);
+        op.latency.record(latency);
+    }
+    // An operation failed: NAK'd, timed out or otherwise.
+    void recordError(OperationKind kind)
+    {
+        this->operations[static_cast<size_t>(kind)].errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    void recordNak(uint32_t status)
+    {
+        // Slots are claimed once, by storing status + 1 into an empty (zero) key, and never released.
+        uint64_t const key = uint64_t{ status } + 1;
+        for (auto& slot : this->nak_slots) {
+            auto current = slot.key.load(std::memory_order_acquire);
+            if (current == 0 && slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel))
+                current = key;
+            if (current == key) {
+                slot.count.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        this->naks_other.fetch_add(1, std::memory_order_relaxed);
+    }
+    void recordCrcFailure() { this->crc_failures.fetch_add(1, std::memory_order_relaxed); }
+    void recordMalformed() { this->malformed.fetch_add(1, std::memory_order_relaxed); }
+    void recordTimeout() { this->timeouts.fetch_add(1, std::memory_order_relaxed); }
+    void recordRetry() { this->retries.fetch_add(1, std::memory_order_relaxed); }
+    void recordStaleResponse() { this->stale_responses.fetch_add(1, std::memory_order_relaxed); }
+
+    Snapshot snapshot() const
+    {
+        Snapshot s;
+        for (size_t i = 0; i < operation_kind_count; i++) {
+            s.operations[i].count = this->operations[i].count.load(std::memory_order_relaxed);
+            s.operations[i].errors = this->operations[i].errors.load(std::memory_order_relaxed);
+            s.operations[i].latency = this->operations[i].latency.snapshot();
+        }
+        for (auto const& slot : this->nak_slots) {
+            auto const key = slot.key.load(std::memory_order_acquire);
+            if (key == 0)
+                break;
+            s.naks.emplace_back(static_cast<uint32_t>(key - 1), slot.count.load(std::memory_order_relaxed));
+        }
+        s.naks_other = this->naks_other.load(std::memory_order_relaxed);
+        s.crc_failures = this->crc_failures.load(std::memory_order_relaxed);
+        s.malformed = this->malformed.load(std::memory_order_relaxed);
+        s.timeouts = this->timeouts.load(std::memory_order_relaxed);
+        s.retries = this->retries.load(std::memory_order_relaxed);
+        s.stale_responses = this->stale_responses.load(std::memory_order_relaxed);
+        s.in_flight = this->in_flight.load(std::memory_order_relaxed);
+        s.max_in_flight = this->max_in_flight.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    struct Operation {
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> errors{ 0 };
+        LatencyHistogram latency;
+    };
+    struct NakSlot {
+        std::atomic<uint64_t> key{ 0 };
+        std::atomic<uint64_t> count{ 0 };
+    };
+    std::array<Operation, operation_kind_count> operations{};
+    std::array<NakSlot, nak_status_slots> nak_slots{};
+    std::atomic<uint64_t> naks_other{ 0 };
+    std::atomic<uint64_t> crc_failures{ 0 };
+    std::atomic<uint64_t> malformed{ 0 };
+    std::atomic<uint64_t> timeouts{ 0 };
+    std::atomic<uint64_t> retries{ 0 };
+    std::atomic<uint64_t> stale_responses{ 0 };
+    std::atomic<uint64_t> in_flight{ 0 };
+    std::atomic<uint64_t> max_in_flight{ 0 };
+};
+
+// Counters kept by an instrumented transport (makeSyncInstrumentedTransport), shared with whoever reports them.
+// Messages are counted by their MessageType, read from the header, in each direction.
+class TransportStats
+{
+public:
+    struct MessageCount {
+        uint8_t type = 0;
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+    };
+    struct Snapshot {
+        // Only message types seen at least once, by type value.
+        std::vector<MessageCount> sent;
+        std::vector<MessageCount> received;
+        uint64_t recv_timeouts = 0;
+        uint64_t errors = 0;
+
+        std::string toText() const
+        {
+            std::string text;
+            auto const counts = [&](std::string_view direction, std::vector<MessageCount> const& counts) {
+                for (auto const& c : counts)
+                    text += std::format("{} {}: {} messages, {} bytes\n", direction, messageTypeName(c.type), c.messages, c.bytes);
+            };
+            counts("sent", this->sent);
+            counts("received", this->received);
+            text += std::format("recv_timeouts={} errors={}\n", this->recv_timeouts, this->errors);
+            return text;
+        }
+        std::string toJson() const
+        {
+            auto const counts = [](std::vector<MessageCount> const& counts) {
+                std::string json = "{";
+                for (size_t i = 0; i < counts.size(); i++)
+                    json += std::format(R"({}"0x{:02X}":{{"name":"{}","messages":{},"bytes":{}}})", i == 0 ? "" : ",", counts[i].type, messageTypeName(counts[i].type), counts[i].messages, counts[i].bytes);
+                return json + "}";
+            };
+            return std::format(R"({{"sent":{},"received":{},"recv_timeouts":{},"errors":{}}})", counts(this->sent), counts(this->received), this->recv_timeouts, this->errors);
+        }
+    };
+
+    void recordSent(uint8_t type, size_t bytes) { this->sent.record(type, bytes); }
+    void recordReceived(uint8_t type, size_t bytes) { this->received.record(type, bytes); }
+    void recordTimeout() { this->recv_timeouts.fetch_add(1, std::memory_order_relaxed); }
+    void recordError() { this->errors.fetch_add(1, std::memory_order_relaxed); }
+
+    Snapshot snapshot() const
+    {
+        Snapshot s;
+        s.sent = this->sent.snapshot();
+        s.received = this->received.snapshot();
+        s.recv_timeouts = this->recv_timeouts.load(std::memory_order_relaxed);
+        s.errors = this->errors.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    struct Direction {
+        std::array<std::atomic<uint64_t>, 256> messages{};
+        std::array<std::atomic<uint64_t>, 256> bytes{};
+
+        void record(uint8_t type, size_t size)
+        {
+            this->messages[type].fetch_add(1, std::memory_order_relaxed);
+            this->bytes[type].fetch_add(size, std::memory_order_relaxed);
+        }
+        std::vector<MessageCount> snapshot() const
+        {
+            std::vector<MessageCount> counts;
+            for (size_t type = 0; type < 256; type++) {
+                auto const messages = this->messages[type].load(std::memory_order_relaxed);
+                if (messages != 0)
+                    counts.push_back(MessageCount{ .type = static_cast<uint8_t>(type), .messages = messages, .bytes = this->bytes[type].load(std::memory_order_relaxed) });
+            }
+            return counts;
+        }
+    };
+    Direction sent;
+    Direction received;
+    std::atomic<uint64_t> recv_timeouts{ 0 };
+    std::atomic<uint64_t> errors{ 0 };
+};
+
+}
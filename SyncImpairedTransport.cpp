@@ -0,0 +1,222 @@
+#include "Transports.h"
+#include "VirtualClock.h"
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace RAP::Transport {
+
+// Sent messages are impaired and put in flight, ordered by delivery time, then handed to the inner transport.
+// On real time, a courier thread hands each one over when it is due.
+// On a virtual clock nothing waits: messages stay in flight until a receive is (or gets) pending on this transport,
+// meaning its owner is waiting for the peer.  Then the clock jumps to each delivery time in turn and the messages
+// are handed over, so a burst of pipelined messages arrives after one latency plus its serialization time.
+class ImpairedTransport : public ISyncWireTransport
+{
+private:
+    struct InFlight {
+        std::chrono::nanoseconds deliver_at;
+        uint64_t seq;
+        Buffer message;
+        bool operator>(InFlight const& other) const
+        {
+            return std::tie(this->deliver_at, this->seq) > std::tie(other.deliver_at, other.seq);
+        }
+    };
+public:
+    ImpairedTransport(std::unique_ptr<ISyncWireTransport> inner_, ImpairmentOptions const& options_)
+        : inner(std::move(inner_))
+        , options(options_)
+        , timeout(std::chrono::seconds(1))
+        , rng(options_.seed)
+    {
+        if (!this->options.clock)
+            this->courier = std::jthread([this](std::stop_token stoken) { this->deliverOnTime(stoken); });
+    }
+    static std::string_view getDomain() { return "ImpairedTransport"; }
+
+    virtual void send(BufferView buffer) override
+    {
+        std::lock_guard lg{ this->mtx };
+        if (this->error)
+            std::rethrow_exception(std::exchange(this->error, nullptr));
+        auto const now = this->now();
+        auto sent_at = now;
+        if (this->options.bandwidth_bps != 0) {
+            this->link_free_at = std::max(this->link_free_at, now) + std::chrono::nanoseconds(buffer.size() * 8'000'000'000ull / this->options.bandwidth_bps);
+            sent_at = this->link_free_at;
+        }
+        if (this->chance(this->options.loss))
+            return;
+        auto deliver_at = sent_at + this->options.latency;
+        if (this->options.jitter.count() > 0)
+            deliver_at += std::chrono::nanoseconds(std::uniform_int_distribution<int64_t>(0, std::chrono::nanoseconds(this->options.jitter).count())(this->rng));
+        if (this->chance(this->options.reorder))
+            deliver_at += this->options.reorder_delay;
+        Buffer message{ buffer.begin(), buffer.end() };
+        this->corrupt(message);
+        if (this->chance(this->options.duplicate))
+            this->launch(deliver_at, message);
+        this->launch(deliver_at, std::move(message));
+
+        if (!this->options.clock)
+            this->cv.notify_one();
+        else if (this->receivers_waiting > 0)
+            this->deliverAllLocked();
+        else
+            this->deliverDueLocked(now);
+    }
+    virtual Buffer recv() override
+    {
+        return this->receive([&] { return this->inner->recv(); });
+    }
+    virtual Buffer recv(std::stop_token stoken) override
+    {
+        return this->receive([&] { return this->inner->recv(stoken); });
+    }
+    virtual size_t recv(std::span<uint8_t> buffer) override
+    {
+        return this->receive([&] { return this->inner->recv(buffer); });
+    }
+    virtual size_t recv(std::span<uint8_t> buffer, std::stop_token stoken) override
+    {
+        return this->receive([&] { return this->inner->recv(buffer, stoken); });
+    }
+    virtual uint16_t getMaxMessageSize() const override
+    {
+        return this->inner->getMaxMessageSize();
+    }
+    virtual void setTimeout(std::chrono::microseconds new_timeout) override
+    {
+        this->timeout = new_timeout;
+        this->inner->setTimeout(new_timeout);
+    }
+    virtual std::optional<std::chrono::microseconds> getTimeout() const override
+    {
+        return this->timeout;
+    }
+
+private:
+    std::chrono::nanoseconds now() const
+    {
+        if (this->options.clock)
+            return this->options.clock->now();
+        return std::chrono::steady_clock::now().time_since_epoch();
+    }
+    bool chance(double probability)
+    {
+        return probability > 0 && std::uniform_real_distribution<double>(0, 1)(this->rng) < probability;
+    }
+    void corrupt(Buffer& message)
+    {
+        if (!(this->options.bit_error_rate > 0))
+            return;
+        // The gaps between flipped bits are geometrically distributed, so clean bits cost nothing.
+        std::geometric_distribution<uint64_t> gap(this->options.bit_error_rate);
+        for (uint64_t bit = gap(this->rng); bit < message.size() * 8; bit += gap(this->rng) + 1)
+            message[bit / 8] ^= static_cast<uint8_t>(1u << (bit % 8));
+    }
+    // Must be called with `mtx` held.
+    void launch(std::chrono::nanoseconds deliver_at, Buffer message)
+    {
+        this->in_flight.push_back(InFlight{ .deliver_at = deliver_at, .seq = this->next_seq++, .message = std::move(message) });
+        std::push_heap(this->in_flight.begin(), this->in_flight.end(), std::greater<>{});
+    }
+    // Must be called with `mtx` held.  Hands every message due by `now` to the inner transport, in delivery order.
+    void deliverDueLocked(std::chrono::nanoseconds now)
+    {
+        while (!this->in_flight.empty() && this->in_flight.front().deliver_at <= now) {
+            std::pop_heap(this->in_flight.begin(), this->in_flight.end(), std::greater<>{});
+            auto const message = std::move(this->in_flight.back().message);
+            this->in_flight.pop_back();
+            this->inner->send(message);
+        }
+    }
+    // Must be called with `mtx` held, on a virtual clock only.
+    void deliverAllLocked()
+    {
+        while (!this->in_flight.empty()) {
+            this->options.clock->advanceTo(this->in_flight.front().deliver_at);
+            this->deliverDueLocked(this->options.clock->now());
+        }
+    }
+    template <typename Recv>
+    std::invoke_result_t<Recv> receive(Recv&& recv)
+    {
+        if (!this->options.clock)
+            return recv();
+        {
+            std::lock_guard lg{ this->mtx };
+            this->deliverAllLocked();
+            this->receivers_waiting++;
+        }
+        try {
+            auto result = recv();
+            std::lock_guard lg{ this->mtx };
+            this->receivers_waiting--;
+            return result;
+        }
+        catch (TransportTimeoutException const&) {
+            // The inner transport waited in real time; the wait still has to show on the virtual clock.
+            this->options.clock->advance(this->timeout);
+            std::lock_guard lg{ this->mtx };
+            this->receivers_waiting--;
+            throw;
+        }
+        catch (...) {
+            std::lock_guard lg{ this->mtx };
+            this->receivers_waiting--;
+            throw;
+        }
+    }
+    void deliverOnTime(std::stop_token stoken)
+    {
+        std::unique_lock lk{ this->mtx };
+        while (!stoken.stop_requested()) {
+            if (this->in_flight.empty()) {
+                this->cv.wait(lk, stoken, [&] { return !this->in_flight.empty(); });
+                continue;
+            }
+            // Wake up early if a message due sooner is sent meanwhile.
+            auto const deliver_at = this->in_flight.front().deliver_at;
+            this->cv.wait_until(lk, stoken, std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(deliver_at)), [&] {
+                return this->in_flight.front().deliver_at != deliver_at;
+            });
+            try {
+                this->deliverDueLocked(this->now());
+            }
+            catch (...) {
+                // Reported by the next send(); the message is lost.
+                this->error = std::current_exception();
+            }
+        }
+    }
+
+private:
+    std::unique_ptr<ISyncWireTransport> inner;
+    ImpairmentOptions options;
+    std::chrono::microseconds timeout;
+    std::mutex mtx;
+    std::condition_variable_any cv;
+    std::mt19937_64 rng;
+    // A min-heap on (deliver_at, seq).
+    std::vector<InFlight> in_flight;
+    uint64_t next_seq = 0;
+    std::chrono::nanoseconds link_free_at{ 0 };
+    size_t receivers_waiting = 0;
+    std::exception_ptr error;
+    std::jthread courier;
+};
+
+std::unique_ptr<ISyncWireTransport> makeSyncImpairedTransport(std::unique_ptr<ISyncWireTransport> inner, ImpairmentOptions const& options)
+{
+    return std::make_unique<ImpairedTransport>(std::move(inner), options);
+}
+
+}
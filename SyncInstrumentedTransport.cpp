@@ -0,0 +1,105 @@
+#include "Transports.h"
+#include "Stats.h"
+#include <type_traits>
+
+namespace RAP::Transport {
+
+// Counts the traffic of the transport it wraps.  A message's type is its second byte, after the transaction id.
+class InstrumentedTransport : public ISyncWireTransport
+{
+public:
+    InstrumentedTransport(std::unique_ptr<ISyncWireTransport> inner_, std::shared_ptr<TransportStats> stats_)
+        : inner(std::move(inner_))
+        , stats(std::move(stats_))
+    {}
+    static std::string_view getDomain() { return "InstrumentedTransport"; }
+
+    virtual void send(BufferView buffer) override
+    {
+        this->count([&] { this->inner->send(buffer); });
+        this->stats->recordSent(messageType(buffer), buffer.size());
+    }
+    virtual void send(std::span<BufferView const> parts) override
+    {
+        this->count([&] { this->inner->send(parts); });
+        size_t size = 0;
+        uint8_t type = 0;
+        for (auto const part : parts) {
+            if (size <= 1 && size + part.size() > 1)
+                type = part[1 - size];
+            size += part.size();
+        }
+        this->stats->recordSent(type, size);
+    }
+    virtual Buffer recv() override
+    {
+        auto buffer = this->count([&] { return this->inner->recv(); });
+        this->stats->recordReceived(messageType(buffer), buffer.size());
+        return buffer;
+    }
+    virtual Buffer recv(std::stop_token stoken) override
+    {
+        auto buffer = this->count([&] { return this->inner->recv(stoken); });
+        if (!buffer.empty())
+            this->stats->recordReceived(messageType(buffer), buffer.size());
+        return buffer;
+    }
+    virtual size_t recv(std::span<uint8_t> buffer) override
+    {
+        auto const size = this->count([&] { return this->inner->recv(buffer); });
+        this->stats->recordReceived(messageType(buffer.first(size)), size);
+        return size;
+    }
+    virtual size_t recv(std::span<uint8_t> buffer, std::stop_token stoken) override
+    {
+        auto const size = this->count([&] { return this->inner->recv(buffer, stoken); });
+        // 0 means the receive was stopped.
+        if (size != 0)
+            this->stats->recordReceived(messageType(buffer.first(size)), size);
+        return size;
+    }
+    virtual uint16_t getMaxMessageSize() const override
+    {
+        return this->inner->getMaxMessageSize();
+    }
+    virtual void setTimeout(std::chrono::microseconds timeout) override
+    {
+        this->inner->setTimeout(timeout);
+    }
+    virtual std::optional<std::chrono::microseconds> getTimeout() const override
+    {
+        return this->inner->getTimeout();
+    }
+
+private:
+    static uint8_t messageType(BufferView message)
+    {
+        return message.size() > 1 ? message[1] : 0;
+    }
+    template <typename Fn>
+    std::invoke_result_t<Fn> count(Fn&& fn)
+    {
+        try {
+            return fn();
+        }
+        catch (TransportTimeoutException const&) {
+            this->stats->recordTimeout();
+            throw;
+        }
+        catch (...) {
+            this->stats->recordError();
+            throw;
+        }
+    }
+
+private:
+    std::unique_ptr<ISyncWireTransport> inner;
+    std::shared_ptr<TransportStats> stats;
+};
+
+std::unique_ptr<ISyncWireTransport> makeSyncInstrumentedTransport(std::unique_ptr<ISyncWireTransport> inner, std::shared_ptr<TransportStats> stats)
+{
+    return std::make_unique<InstrumentedTransport>(std::move(inner), std::move(stats));
+}
+
+}
@@ -1,61 +1,40 @@
 #include "Transports.h"
+#include "SpscRing.h"
 #include <YALF/YALF.h>
-#include <condition_variable>
+#include <algorithm>
 #include <format>
-#include <mutex>
-#include <queue>
+#include <memory>
+#include <new>
 
 namespace RAP::Transport {
 
+// One direction of a paired transport: an SpscRing over memory owned by this object.
 class IpcTransportQueue
 {
 public:
-    void push(BufferView buffer)
-    {
-        {
-            std::lock_guard lg{ this->mtx };
-            this->queue.push(Buffer{ buffer.begin(), buffer.end() });
-        }
-        this->cv.notify_one();
-    }
-    Buffer pop(std::chrono::microseconds timeout, std::stop_token stoken)
-    {
-        std::unique_lock lk{ this->mtx };
-        this->cv.wait_for(lk, stoken, timeout, [&] {
-            return this->queue.size() > 0;
-        });
-        if (stoken.stop_requested())
-            return Buffer{};
-        if (this->queue.size() == 0)
-            throw TransportTimeoutException();
-        Buffer buffer = std::move(this->queue.front());
-        this->queue.pop();
-        lk.unlock();
-        return buffer;
-    }
-    Buffer pop(std::chrono::microseconds timeout)
-    {
-        std::unique_lock lk{ this->mtx };
-        this->cv.wait_for(lk, timeout, [&] {
-            return this->queue.size() > 0;
-        });
-        if (this->queue.size() == 0)
-            throw TransportTimeoutException();
-        Buffer buffer = std::move(this->queue.front());
-        this->queue.pop();
-        lk.unlock();
-        return buffer;
-    }
+    static constexpr uint32_t SlotCount = 64;
+
+    explicit IpcTransportQueue(size_t max_message_size)
+        : memory(static_cast<uint8_t*>(::operator new(SpscRing<CvParker>::requiredBytes(SlotCount, max_message_size), std::align_val_t{ 64 })))
+        , ring(this->memory.get(), SlotCount, max_message_size, true)
+    {}
+
+    SpscRing<CvParker>& get() { return this->ring; }
 
 private:
-    std::mutex mtx;
-    std::condition_variable_any cv;
-    std::queue<Buffer> queue;
+    struct AlignedDelete {
+        void operator()(uint8_t* p) const { ::operator delete(p, std::align_val_t{ 64 }); }
+    };
+    std::unique_ptr<uint8_t, AlignedDelete> memory;
+    SpscRing<CvParker> ring;
 };
 
 class PairedIpcTransport : public ISyncWireTransport
 {
 public:
+    // How long send() waits for the peer to make room, at most; the receive timeout defaults to a year.
+    static constexpr std::chrono::microseconds MaxSendWait = std::chrono::seconds(1);
+
     PairedIpcTransport(std::shared_ptr<IpcTransportQueue> tx_queue_, std::shared_ptr<IpcTransportQueue> rx_queue_, size_t max_message_size_, bool log = false)
         : tx_queue(std::move(tx_queue_))
         , rx_queue(std::move(rx_queue_))
@@ -72,22 +51,41 @@ public:
                 std::format_to(std::back_inserter(data_str), "{:02x} ", d);
             LOG_NOISE(this, "send >>> [ {}]", data_str);
         }
-        this->tx_queue->push(buffer);
+        this->tx_queue->get().push(buffer, std::min(this->timeout, MaxSendWait));
     }
     virtual Buffer recv() override
     {
-        auto buffer = this->rx_queue->pop(this->timeout);
-        if (log) {
-            std::string data_str;
-            for (auto const d : buffer)
-                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
-            LOG_NOISE(this, "recv <<< [ {}]", data_str);
-        }
+        Buffer buffer;
+        this->rx_queue->get().pop([&](BufferView message) {
+            buffer.assign(message.begin(), message.end());
+        }, this->timeout);
+        this->logRecv(buffer);
         return buffer;
     }
     virtual Buffer recv(std::stop_token stoken) override
     {
-        return this->rx_queue->pop(this->timeout, stoken);
+        Buffer buffer;
+        this->rx_queue->get().pop([&](BufferView message) {
+            buffer.assign(message.begin(), message.end());
+        }, this->timeout, stoken);
+        return buffer;
+    }
+    virtual size_t recv(std::span<uint8_t> buffer) override
+    {
+        size_t size = 0;
+        this->rx_queue->get().pop([&](BufferView message) {
+            size = this->copyOut(message, buffer);
+        }, this->timeout);
+        this->logRecv(buffer.first(size));
+        return size;
+    }
+    virtual size_t recv(std::span<uint8_t> buffer, std::stop_token stoken) override
+    {
+        size_t size = 0;
+        this->rx_queue->get().pop([&](BufferView message) {
+            size = this->copyOut(message, buffer);
+        }, this->timeout, stoken);
+        return size;
     }
     virtual uint16_t getMaxMessageSize() const override
     {
@@ -97,6 +95,28 @@ public:
     {
         this->timeout = new_timeout;
     }
+    virtual std::optional<std::chrono::microseconds> getTimeout() const override
+    {
+        return this->timeout;
+    }
+
+private:
+    void logRecv(BufferView buffer)
+    {
+        if (log) {
+            std::string data_str;
+            for (auto const d : buffer)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "recv <<< [ {}]", data_str);
+        }
+    }
+    size_t copyOut(BufferView message, std::span<uint8_t> buffer)
+    {
+        if (message.size() > buffer.size())
+            throw MessageSizeException("Received message does not fit in the supplied buffer");
+        std::copy(message.begin(), message.end(), buffer.begin());
+        return message.size();
+    }
 
 private:
     std::shared_ptr<IpcTransportQueue> tx_queue;
@@ -108,8 +128,8 @@ private:
 
 std::pair<std::unique_ptr<ISyncWireTransport>, std::unique_ptr<ISyncWireTransport>> makeSyncPairedIpcTransport(size_t max_message_size)
 {
-    auto q1 = std::make_shared<IpcTransportQueue>();
-    auto q2 = std::make_shared<IpcTransportQueue>();
+    auto q1 = std::make_shared<IpcTransportQueue>(max_message_size);
+    auto q2 = std::make_shared<IpcTransportQueue>(max_message_size);
     return {
         std::make_unique<PairedIpcTransport>(q1, q2, max_message_size, true),
         std::make_unique<PairedIpcTransport>(q2, q1, max_message_size)
@@ -0,0 +1,250 @@
+#include "Transports.h"
+#include "BufferPool.h"
+#include "Cobs.h"
+#include "FdWait.h"
+#include <YALF/YALF.h>
+#include <cerrno>
+#include <format>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace RAP::Transport {
+
+namespace {
+
+speed_t toSpeed(uint32_t baud_rate)
+{
+    switch (baud_rate) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 500000: return B500000;
+        case 576000: return B576000;
+        case 921600: return B921600;
+        case 1000000: return B1000000;
+        case 1152000: return B1152000;
+        case 1500000: return B1500000;
+        case 2000000: return B2000000;
+        case 2500000: return B2500000;
+        case 3000000: return B3000000;
+        case 3500000: return B3500000;
+        case 4000000: return B4000000;
+        default: throw Exception(std::format("Unsupported serial baud rate {}", baud_rate));
+    }
+}
+
+// Raw 8N1 without flow control; reads return whatever is available (VMIN=0, VTIME=0) and timeouts come from ppoll.
+void configureRaw(int fd, std::optional<uint32_t> baud_rate)
+{
+    if (!::isatty(fd))
+        return;
+    termios tio{};
+    if (::tcgetattr(fd, &tio) != 0)
+        detail::throwErrno("tcgetattr");
+    ::cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (baud_rate) {
+        auto const speed = toSpeed(*baud_rate);
+        ::cfsetispeed(&tio, speed);
+        ::cfsetospeed(&tio, speed);
+    }
+    if (::tcsetattr(fd, TCSANOW, &tio) != 0)
+        detail::throwErrno("tcsetattr");
+}
+
+}
+
+// Messages are COBS-framed on the byte stream.  Reads are done in large blocks and may complete several
+// messages at once; those are queued for subsequent recv() calls.
+class SerialTransport : public ISyncWireTransport
+{
+private:
+    static constexpr size_t ReadChunkSize = 4096;
+public:
+    SerialTransport(int fd_, size_t max_message_size_, Cobs::Deframer::Validator validator, bool log_)
+        : fd(fd_)
+        , is_tty(::isatty(fd_) == 1)
+        , wake_fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+        , max_message_size(max_message_size_)
+        , timeout(std::chrono::seconds(1))
+        , deframer(max_message_size_, std::move(validator))
+        , rx_chunk(ReadChunkSize)
+        , pool(max_message_size_, 4)
+        , log(log_)
+    {
+        if (this->wake_fd < 0) {
+            ::close(this->fd);
+            detail::throwErrno("eventfd");
+        }
+        auto const flags = ::fcntl(this->fd, F_GETFL);
+        if (flags < 0 || ::fcntl(this->fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+            auto const err = errno;
+            ::close(this->wake_fd);
+            ::close(this->fd);
+            throw std::system_error(err, std::system_category(), "fcntl");
+        }
+        this->tx_buffer.reserve(Cobs::maxFrameSize(max_message_size_));
+    }
+    ~SerialTransport()
+    {
+        ::close(this->wake_fd);
+        ::close(this->fd);
+    }
+    static std::string_view getDomain() { return "SerialTransport"; }
+
+    virtual void send(BufferView buffer) override
+    {
+        if (log) {
+            std::string data_str;
+            for (auto const d : buffer)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "send >>> [ {}]", data_str);
+        }
+        if (buffer.size() > this->max_message_size)
+            throw MessageSizeException("Message exceeds the transport's max_message_size");
+        this->tx_buffer.clear();
+        Cobs::encode(buffer, this->tx_buffer);
+        BufferView remaining{ this->tx_buffer };
+        while (!remaining.empty()) {
+            auto const n = ::write(this->fd, remaining.data(), remaining.size());
+            if (n >= 0) {
+                remaining = remaining.subspan(n);
+                continue;
+            }
+            if (errno == EAGAIN)
+                detail::waitFd(this->fd, POLLOUT, -1, this->timeout, {});
+            else if (errno == EIO)
+                throw TransportClosedException();
+            else if (errno != EINTR)
+                detail::throwErrno("write");
+        }
+    }
+    virtual Buffer recv() override
+    {
+        return this->recv(std::stop_token{});
+    }
+    virtual Buffer recv(std::stop_token stoken) override
+    {
+        Buffer buffer(this->max_message_size);
+        buffer.resize(this->recv(buffer, stoken));
+        return buffer;
+    }
+    virtual size_t recv(std::span<uint8_t> buffer) override
+    {
+        return this->recv(buffer, std::stop_token{});
+    }
+    virtual size_t recv(std::span<uint8_t> buffer, std::stop_token stoken) override
+    {
+        auto const deadline = std::chrono::steady_clock::now() + this->timeout;
+        bool ready = false;
+        while (this->messages.empty()) {
+            auto const n = ::read(this->fd, this->rx_chunk.data(), this->rx_chunk.size());
+            auto const polled_ready = std::exchange(ready, false);
+            if (n > 0) {
+                this->deframer.feed(BufferView{ this->rx_chunk }.first(n), [&](BufferView message) {
+                    auto pooled = this->pool.lease();
+                    pooled->assign(message.begin(), message.end());
+                    this->messages.push(std::move(pooled));
+                });
+                continue;
+            }
+            // End-of-file, e.g. from a pipe whose writer has gone away.  A raw tty also reads 0 bytes when it merely
+            // has no data, so there it only counts after ppoll reported the fd ready.
+            if (n == 0 && (!this->is_tty || polled_ready))
+                throw TransportClosedException();
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && errno != EAGAIN) {
+                // A pty whose other end has been closed reports EIO.
+                if (errno == EIO)
+                    throw TransportClosedException();
+                detail::throwErrno("read");
+            }
+            auto const remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0)
+                throw TransportTimeoutException();
+            if (!detail::waitFd(this->fd, POLLIN, this->wake_fd, remaining, stoken))
+                return 0;
+            ready = true;
+        }
+        auto const message = this->messages.pop();
+        if (message->size() > buffer.size())
+            throw MessageSizeException("Received message does not fit in the supplied buffer");
+        std::copy(message->begin(), message->end(), buffer.begin());
+        if (log) {
+            std::string data_str;
+            for (auto const d : *message)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "recv <<< [ {}]", data_str);
+        }
+        return message->size();
+    }
+    virtual uint16_t getMaxMessageSize() const override
+    {
+        return static_cast<uint16_t>(this->max_message_size);
+    }
+    virtual void setTimeout(std::chrono::microseconds new_timeout) override
+    {
+        this->timeout = new_timeout;
+    }
+    virtual std::optional<std::chrono::microseconds> getTimeout() const override
+    {
+        return this->timeout;
+    }
+
+private:
+    int fd;
+    bool is_tty;
+    int wake_fd;
+    size_t max_message_size;
+    std::chrono::microseconds timeout;
+    Cobs::Deframer deframer;
+    Buffer rx_chunk;
+    Buffer tx_buffer;
+    // Declared before `messages`, whose buffers are returned to it on destruction.
+    BufferPool pool;
+    PooledBufferQueue messages;
+    bool log;
+};
+
+std::unique_ptr<ISyncWireTransport> makeSyncSerialTransport(std::string_view device, uint32_t baud_rate, size_t max_message_size, std::function<bool(BufferView)> frame_validator, bool log)
+{
+    auto const fd = ::open(std::string{ device }.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0)
+        throw std::system_error(errno, std::system_category(), std::format("open({})", device));
+    try {
+        configureRaw(fd, baud_rate);
+        ::tcflush(fd, TCIOFLUSH);
+    }
+    catch (...) {
+        ::close(fd);
+        throw;
+    }
+    return std::make_unique<SerialTransport>(fd, max_message_size, std::move(frame_validator), log);
+}
+std::unique_ptr<ISyncWireTransport> makeSyncSerialTransport(int fd, size_t max_message_size, std::function<bool(BufferView)> frame_validator, bool log)
+{
+    try {
+        configureRaw(fd, std::nullopt);
+    }
+    catch (...) {
+        ::close(fd);
+        throw;
+    }
+    return std::make_unique<SerialTransport>(fd, max_message_size, std::move(frame_validator), log);
+}
+
+}
@@ -0,0 +1,301 @@
+#include "Transports.h"
+#include "SpscRing.h"
+#include <YALF/YALF.h>
+#include <atomic>
+#include <climits>
+#include <format>
+#include <string>
+#include <system_error>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace RAP::Transport {
+
+// Parks a thread on a futex in shared memory, so the other side may be in another process.
+class FutexParker
+{
+public:
+    FutexParker(std::atomic<uint32_t>& parked_, std::atomic<uint32_t>& seq_) : parked(parked_), seq(seq_) {}
+
+    template <typename Ready>
+    bool wait(Ready&& ready, std::chrono::steady_clock::time_point deadline, std::stop_token stoken)
+    {
+        std::stop_callback const on_stop(stoken, [this] {
+            this->seq.fetch_add(1, std::memory_order_release);
+            futex(this->seq, FUTEX_WAKE, INT_MAX, nullptr);
+        });
+        this->parked.store(1, std::memory_order_relaxed);
+        // Pairs with the fence in wake(): either this side sees the new state, or that side sees `parked`.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ok = false;
+        while (true) {
+            // Sampled before checking, so a wake in between makes the futex wait return immediately.
+            auto const observed = this->seq.load(std::memory_order_acquire);
+            if (ready()) {
+                ok = true;
+                break;
+            }
+            if (stoken.stop_requested())
+                break;
+            auto const remaining = deadline - std::chrono::steady_clock::now();
+            if (remaining <= std::chrono::steady_clock::duration::zero())
+                break;
+            auto const secs = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+            timespec const ts{
+                .tv_sec = static_cast<time_t>(secs.count()),
+                .tv_nsec = static_cast<long>(std::chrono::duration_cast<std::chrono::nanoseconds>(remaining - secs).count()),
+            };
+            futex(this->seq, FUTEX_WAIT, observed, &ts);
+        }
+        this->parked.store(0, std::memory_order_relaxed);
+        return ok;
+    }
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (this->parked.load(std::memory_order_relaxed)) {
+            this->seq.fetch_add(1, std::memory_order_release);
+            futex(this->seq, FUTEX_WAKE, 1, nullptr);
+        }
+    }
+
+private:
+    static void futex(std::atomic<uint32_t>& word, int op, uint32_t val, timespec const* timeout)
+    {
+        // Not FUTEX_PRIVATE_FLAG: the word is shared between processes.
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free);
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op, val, timeout, nullptr, 0);
+    }
+
+    std::atomic<uint32_t>& parked;
+    std::atomic<uint32_t>& seq;
+};
+
+// Layout of the segment: this header, then the client-to-server ring, then the server-to-client ring.
+struct SharedMemorySegmentHeader {
+    static constexpr uint64_t Magic = 0x3130'4D48'5350'4152; // "RAPSHM01"
+    static constexpr uint32_t SlotCount = 64;
+
+    // Written last by the server, once both rings are initialized.
+    alignas(64) std::atomic<uint64_t> magic;
+    uint32_t max_message_size;
+    uint32_t slot_count;
+};
+
+class SharedMemoryTransport : public ISyncWireTransport
+{
+private:
+    using Ring = SpscRing<FutexParker>;
+public:
+    // Server: creates and initializes the segment.
+    SharedMemoryTransport(std::string_view name_, size_t max_message_size_, bool log_)
+        : name(name_)
+        , is_server(true)
+        , timeout(std::chrono::seconds(1))
+        , log(log_)
+    {
+        if (max_message_size_ > UINT16_MAX)
+            throw MessageSizeException("Shared memory transport max_message_size must fit in 16 bits");
+        this->fd = ::shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (this->fd < 0 && errno == EEXIST) {
+            // Most likely left behind by a server that crashed.  Clients still attached to it keep their mapping.
+            LOG_ERROR(this, "Replacing existing shared memory segment {}", this->name);
+            ::shm_unlink(this->name.c_str());
+            this->fd = ::shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        }
+        if (this->fd < 0)
+            throw std::system_error(errno, std::system_category(), std::format("shm_open({})", this->name));
+        this->size = segmentSize(SharedMemorySegmentHeader::SlotCount, max_message_size_);
+        if (::ftruncate(this->fd, this->size) != 0) {
+            auto const err = errno;
+            this->release();
+            throw std::system_error(err, std::system_category(), std::format("ftruncate({})", this->name));
+        }
+        this->map();
+        auto* const header = new (this->base) SharedMemorySegmentHeader{};
+        header->max_message_size = static_cast<uint32_t>(max_message_size_);
+        header->slot_count = SharedMemorySegmentHeader::SlotCount;
+        this->attach(*header, true);
+        header->magic.store(SharedMemorySegmentHeader::Magic, std::memory_order_release);
+    }
+    // Client: attaches to a segment created by a server.
+    SharedMemoryTransport(std::string_view name_, bool log_)
+        : name(name_)
+        , is_server(false)
+        , timeout(std::chrono::seconds(1))
+        , log(log_)
+    {
+        this->fd = ::shm_open(this->name.c_str(), O_RDWR, 0);
+        if (this->fd < 0)
+            throw std::system_error(errno, std::system_category(), std::format("shm_open({})", this->name));
+        struct stat st{};
+        if (::fstat(this->fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SharedMemorySegmentHeader)) {
+            this->release();
+            throw Exception(std::format("Shared memory segment {} is not initialized", this->name));
+        }
+        this->size = st.st_size;
+        this->map();
+        auto* const header = std::launder(reinterpret_cast<SharedMemorySegmentHeader*>(this->base));
+        if (header->magic.load(std::memory_order_acquire) != SharedMemorySegmentHeader::Magic
+            || this->size < segmentSize(header->slot_count, header->max_message_size)) {
+            this->release();
+            throw Exception(std::format("Shared memory segment {} is not an initialized RAP transport", this->name));
+        }
+        this->attach(*header, false);
+    }
+    ~SharedMemoryTransport()
+    {
+        this->tx.reset();
+        this->rx.reset();
+        this->release();
+    }
+    static std::string_view getDomain() { return "SharedMemoryTransport"; }
+
+    virtual void send(BufferView buffer) override
+    {
+        if (log) {
+            std::string data_str;
+            for (auto const d : buffer)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "send >>> [ {}]", data_str);
+        }
+        this->tx->push(buffer, this->timeout);
+    }
+    virtual Buffer recv() override
+    {
+        Buffer buffer;
+        this->rx->pop([&](BufferView message) {
+            buffer.assign(message.begin(), message.end());
+        }, this->timeout);
+        this->logRecv(buffer);
+        return buffer;
+    }
+    virtual Buffer recv(std::stop_token stoken) override
+    {
+        Buffer buffer;
+        this->rx->pop([&](BufferView message) {
+            buffer.assign(message.begin(), message.end());
+        }, this->timeout, stoken);
+        this->logRecv(buffer);
+        return buffer;
+    }
+    virtual size_t recv(std::span<uint8_t> buffer) override
+    {
+        size_t size_ = 0;
+        this->rx->pop([&](BufferView message) {
+            size_ = copyOut(message, buffer);
+        }, this->timeout);
+        this->logRecv(buffer.first(size_));
+        return size_;
+    }
+    virtual size_t recv(std::span<uint8_t> buffer, std::stop_token stoken) override
+    {
+        size_t size_ = 0;
+        this->rx->pop([&](BufferView message) {
+            size_ = copyOut(message, buffer);
+        }, this->timeout, stoken);
+        this->logRecv(buffer.first(size_));
+        return size_;
+    }
+    virtual uint16_t getMaxMessageSize() const override
+    {
+        return static_cast<uint16_t>(this->tx->getMaxMessageSize());
+    }
+    virtual void setTimeout(std::chrono::microseconds new_timeout) override
+    {
+        this->timeout = new_timeout;
+    }
+    virtual std::optional<std::chrono::microseconds> getTimeout() const override
+    {
+        return this->timeout;
+    }
+
+private:
+    static size_t ringOffset()
+    {
+        return (sizeof(SharedMemorySegmentHeader) + 63) & ~size_t{ 63 };
+    }
+    static size_t segmentSize(uint32_t slot_count, size_t max_message_size)
+    {
+        return ringOffset() + 2 * Ring::requiredBytes(slot_count, max_message_size);
+    }
+    void map()
+    {
+        auto* const p = ::mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+        if (p == MAP_FAILED) {
+            auto const err = errno;
+            this->release();
+            throw std::system_error(err, std::system_category(), std::format("mmap({})", this->name));
+        }
+        this->base = static_cast<uint8_t*>(p);
+    }
+    void attach(SharedMemorySegmentHeader const& header, bool initialize)
+    {
+        auto const ring_bytes = Ring::requiredBytes(header.slot_count, header.max_message_size);
+        auto* const c2s = this->base + ringOffset();
+        auto* const s2c = c2s + ring_bytes;
+        try {
+            this->tx = std::make_unique<Ring>(this->is_server ? s2c : c2s, header.slot_count, header.max_message_size, initialize);
+            this->rx = std::make_unique<Ring>(this->is_server ? c2s : s2c, header.slot_count, header.max_message_size, initialize);
+        }
+        catch (...) {
+            this->tx.reset();
+            this->release();
+            throw;
+        }
+    }
+    void release()
+    {
+        if (this->base)
+            ::munmap(this->base, this->size);
+        if (this->fd >= 0)
+            ::close(this->fd);
+        if (this->is_server)
+            ::shm_unlink(this->name.c_str());
+        this->base = nullptr;
+        this->fd = -1;
+    }
+    void logRecv(BufferView buffer)
+    {
+        if (log) {
+            std::string data_str;
+            for (auto const d : buffer)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "recv <<< [ {}]", data_str);
+        }
+    }
+    static size_t copyOut(BufferView message, std::span<uint8_t> buffer)
+    {
+        if (message.size() > buffer.size())
+            throw MessageSizeException("Received message does not fit in the supplied buffer");
+        std::copy(message.begin(), message.end(), buffer.begin());
+        return message.size();
+    }
+
+private:
+    std::string name;
+    bool is_server;
+    int fd = -1;
+    size_t size = 0;
+    uint8_t* base = nullptr;
+    std::unique_ptr<Ring> tx;
+    std::unique_ptr<Ring> rx;
+    std::chrono::microseconds timeout;
+    bool log;
+};
+
+std::unique_ptr<ISyncWireTransport> makeSyncSharedMemoryServerTransport(std::string_view name, size_t max_message_size, bool log)
+{
+    return std::make_unique<SharedMemoryTransport>(name, max_message_size, log);
+}
+std::unique_ptr<ISyncWireTransport> makeSyncSharedMemoryClientTransport(std::string_view name, bool log)
+{
+    return std::make_unique<SharedMemoryTransport>(name, log);
+}
+
+}
@@ -0,0 +1,389 @@
+#include "Transports.h"
+#include "FdWait.h"
+#include <YALF/YALF.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace RAP::Transport {
+
+namespace {
+
+constexpr size_t LengthPrefixBytes = 2;
+
+struct AddrInfoDeleter {
+    void operator()(addrinfo* ai) const { ::freeaddrinfo(ai); }
+};
+std::unique_ptr<addrinfo, AddrInfoDeleter> resolve(std::string_view host, uint16_t port, bool passive)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo* result = nullptr;
+    auto const host_str = std::string{ host };
+    auto const rc = ::getaddrinfo(host_str.empty() ? nullptr : host_str.c_str(), std::format("{}", port).c_str(), &hints, &result);
+    if (rc != 0)
+        throw Exception(std::format("getaddrinfo({}:{}): {}", host, port, ::gai_strerror(rc)));
+    return std::unique_ptr<addrinfo, AddrInfoDeleter>{ result };
+}
+
+}
+
+// Each message is preceded by its length as a 16-bit little-endian integer.
+// In batching mode, send() only queues framed messages; they are written with one syscall when the batch
+// reaches `batch_flush_bytes` or when recv() is about to block, so responses to pipelined commands
+// (and commands sent back to back) share segments.
+class TcpTransport : public ISyncWireTransport
+{
+public:
+    TcpTransport(int fd_, TcpTransportOptions const& options_)
+        : fd(fd_)
+        , wake_fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+        , options(options_)
+        , timeout(std::chrono::seconds(1))
+        , rx_buffer(std::max<size_t>(65536, 4 * (LengthPrefixBytes + options_.max_message_size)))
+    {
+        if (this->wake_fd < 0) {
+            ::close(this->fd);
+            detail::throwErrno("eventfd");
+        }
+        int const one = 1;
+        if (this->options.no_delay)
+            ::setsockopt(this->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (this->options.batch_writes)
+            this->tx_batch.reserve(this->options.batch_flush_bytes + LengthPrefixBytes + this->options.max_message_size);
+    }
+    ~TcpTransport()
+    {
+        try {
+            std::lock_guard lg{ this->tx_mtx };
+            this->flushLocked();
+        }
+        catch (...) {
+        }
+        ::close(this->wake_fd);
+        ::close(this->fd);
+    }
+    static std::string_view getDomain() { return "TcpTransport"; }
+
+    virtual void send(BufferView buffer) override
+    {
+        if (this->options.log) {
+            std::string data_str;
+            for (auto const d : buffer)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "send >>> [ {}]", data_str);
+        }
+        if (buffer.size() > this->options.max_message_size)
+            throw MessageSizeException("Message exceeds the transport's max_message_size");
+        uint8_t const prefix[LengthPrefixBytes] = { static_cast<uint8_t>(buffer.size()), static_cast<uint8_t>(buffer.size() >> 8) };
+        std::lock_guard lg{ this->tx_mtx };
+        if (this->options.batch_writes) {
+            this->tx_batch.insert(this->tx_batch.end(), std::begin(prefix), std::end(prefix));
+            this->tx_batch.insert(this->tx_batch.end(), buffer.begin(), buffer.end());
+            // Messages sent from another thread while recv() is waiting (e.g. interrupts) are not held back.
+            if (this->tx_batch.size() >= this->options.batch_flush_bytes || this->rx_waiting)
+                this->flushLocked();
+            return;
+        }
+        iovec iov[2] = {
+            { .iov_base = const_cast<uint8_t*>(prefix), .iov_len = LengthPrefixBytes },
+            { .iov_base = const_cast<uint8_t*>(buffer.data()), .iov_len = buffer.size() },
+        };
+        this->writeAll(iov, 2);
+    }
+    virtual void send(std::span<BufferView const> parts) override
+    {
+        // The length prefix and the parts go out in one sendmsg(); longer lists take the copying path.
+        std::array<iovec, 5> iov;
+        if (parts.size() >= iov.size())
+            return ISyncWireTransport::send(parts);
+        if (this->options.log) {
+            std::string data_str;
+            for (auto const part : parts)
+                for (auto const d : part)
+                    std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "send >>> [ {}]", data_str);
+        }
+        size_t size = 0;
+        for (auto const part : parts)
+            size += part.size();
+        if (size > this->options.max_message_size)
+            throw MessageSizeException("Message exceeds the transport's max_message_size");
+        uint8_t const prefix[LengthPrefixBytes] = { static_cast<uint8_t>(size), static_cast<uint8_t>(size >> 8) };
+        std::lock_guard lg{ this->tx_mtx };
+        if (this->options.batch_writes) {
+            this->tx_batch.insert(this->tx_batch.end(), std::begin(prefix), std::end(prefix));
+            for (auto const part : parts)
+                this->tx_batch.insert(this->tx_batch.end(), part.begin(), part.end());
+            if (this->tx_batch.size() >= this->options.batch_flush_bytes || this->rx_waiting)
+                this->flushLocked();
+            return;
+        }
+        iov[0] = iovec{ .iov_base = const_cast<uint8_t*>(prefix), .iov_len = LengthPrefixBytes };
+        for (size_t i = 0; i < parts.size(); i++)
+            iov[i + 1] = iovec{ .iov_base = const_cast<uint8_t*>(parts[i].data()), .iov_len = parts[i].size() };
+        this->writeAll(iov.data(), static_cast<int>(parts.size() + 1));
+    }
+    virtual Buffer recv() override
+    {
+        return this->recv(std::stop_token{});
+    }
+    virtual Buffer recv(std::stop_token stoken) override
+    {
+        Buffer buffer(this->options.max_message_size);
+        buffer.resize(this->recv(buffer, stoken));
+        return buffer;
+    }
+    virtual size_t recv(std::span<uint8_t> buffer) override
+    {
+        return this->recv(buffer, std::stop_token{});
+    }
+    virtual size_t recv(std::span<uint8_t> buffer, std::stop_token stoken) override
+    {
+        auto const deadline = std::chrono::steady_clock::now() + this->timeout;
+        while (!this->haveMessage()) {
+            if (this->options.batch_writes) {
+                // About to wait for the peer, which may be waiting for what we have queued.
+                std::lock_guard lg{ this->tx_mtx };
+                this->flushLocked();
+                this->rx_waiting = true;
+            }
+            this->compactRx();
+            auto const n = ::read(this->fd, this->rx_buffer.data() + this->rx_end, this->rx_buffer.size() - this->rx_end);
+            if (n > 0) {
+                this->rx_end += n;
+                continue;
+            }
+            if (n == 0)
+                throw TransportClosedException();
+            if (errno == ECONNRESET)
+                throw TransportClosedException();
+            if (errno != EAGAIN && errno != EINTR)
+                detail::throwErrno("read");
+            if (errno == EAGAIN) {
+                auto const remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+                if (remaining.count() <= 0)
+                    throw TransportTimeoutException();
+                if (!detail::waitFd(this->fd, POLLIN, this->wake_fd, remaining, stoken))
+                    return 0;
+            }
+        }
+        if (this->options.batch_writes) {
+            std::lock_guard lg{ this->tx_mtx };
+            this->rx_waiting = false;
+        }
+        auto const size = this->pendingLength();
+        auto const message = BufferView{ this->rx_buffer }.subspan(this->rx_begin + LengthPrefixBytes, size);
+        if (size > buffer.size())
+            throw MessageSizeException("Received message does not fit in the supplied buffer");
+        std::copy(message.begin(), message.end(), buffer.begin());
+        this->rx_begin += LengthPrefixBytes + size;
+        if (this->options.log) {
+            std::string data_str;
+            for (auto const d : message)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "recv <<< [ {}]", data_str);
+        }
+        return size;
+    }
+    virtual uint16_t getMaxMessageSize() const override
+    {
+        return static_cast<uint16_t>(this->options.max_message_size);
+    }
+    virtual void setTimeout(std::chrono::microseconds new_timeout) override
+    {
+        this->timeout = new_timeout;
+    }
+    virtual std::optional<std::chrono::microseconds> getTimeout() const override
+    {
+        return this->timeout;
+    }
+
+private:
+    size_t pendingLength() const
+    {
+        return this->rx_buffer[this->rx_begin] | (size_t{ this->rx_buffer[this->rx_begin + 1] } << 8);
+    }
+    bool haveMessage()
+    {
+        auto const available = this->rx_end - this->rx_begin;
+        if (available < LengthPrefixBytes)
+            return false;
+        auto const size = this->pendingLength();
+        if (size > this->options.max_message_size) {
+            // The peer does not speak this protocol, or the stream is out of step: there is no way to resynchronize.
+            // Shutting the connection down makes later receives and sends report it closed as well.
+            ::shutdown(this->fd, SHUT_RDWR);
+            this->rx_begin = this->rx_end = 0;
+            throw TransportClosedException();
+        }
+        return available >= LengthPrefixBytes + size;
+    }
+    // Moves a partial message to the front of rx_buffer so there is room for at least one whole message.
+    void compactRx()
+    {
+        if (this->rx_begin == this->rx_end) {
+            this->rx_begin = this->rx_end = 0;
+        }
+        else if (this->rx_buffer.size() - this->rx_begin < LengthPrefixBytes + this->options.max_message_size) {
+            std::memmove(this->rx_buffer.data(), this->rx_buffer.data() + this->rx_begin, this->rx_end - this->rx_begin);
+            this->rx_end -= this->rx_begin;
+            this->rx_begin = 0;
+        }
+    }
+    // Must be called with tx_mtx held.
+    void flushLocked()
+    {
+        if (this->tx_batch.empty())
+            return;
+        iovec iov{ .iov_base = this->tx_batch.data(), .iov_len = this->tx_batch.size() };
+        this->tx_batch.clear();
+        this->writeAll(&iov, 1);
+    }
+    void writeAll(iovec* iov, int iov_count)
+    {
+        while (iov_count > 0) {
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iov_count;
+            auto n = ::sendmsg(this->fd, &msg, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EPIPE || errno == ECONNRESET)
+                    throw TransportClosedException();
+                if (errno == EAGAIN)
+                    detail::waitFd(this->fd, POLLOUT, -1, this->timeout, {});
+                else if (errno != EINTR)
+                    detail::throwErrno("sendmsg");
+                continue;
+            }
+            while (iov_count > 0 && static_cast<size_t>(n) >= iov->iov_len) {
+                n -= iov->iov_len;
+                iov++;
+                iov_count--;
+            }
+            if (iov_count > 0) {
+                iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + n;
+                iov->iov_len -= n;
+            }
+        }
+    }
+
+private:
+    int fd;
+    int wake_fd;
+    TcpTransportOptions options;
+    std::chrono::microseconds timeout;
+    Buffer rx_buffer;
+    size_t rx_begin = 0;
+    size_t rx_end = 0;
+    // send() may be called from a different thread than recv(), which flushes the batch.
+    std::mutex tx_mtx;
+    Buffer tx_batch;
+    bool rx_waiting = false;
+};
+
+class TcpListener : public ISyncWireListener
+{
+public:
+    TcpListener(std::string_view local_host, uint16_t port, TcpTransportOptions const& options_)
+        : options(options_)
+    {
+        auto const ai = resolve(local_host, port, true);
+        this->fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (this->fd < 0)
+            detail::throwErrno("socket");
+        this->wake_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (this->wake_fd < 0) {
+            ::close(this->fd);
+            detail::throwErrno("eventfd");
+        }
+        int const one = 1;
+        ::setsockopt(this->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(this->fd, ai->ai_addr, ai->ai_addrlen) != 0 || ::listen(this->fd, SOMAXCONN) != 0) {
+            auto const err = errno;
+            ::close(this->wake_fd);
+            ::close(this->fd);
+            throw std::system_error(err, std::system_category(), std::format("bind/listen({}:{})", local_host, port));
+        }
+    }
+    ~TcpListener()
+    {
+        ::close(this->wake_fd);
+        ::close(this->fd);
+    }
+    static std::string_view getDomain() { return "TcpListener"; }
+
+    virtual std::unique_ptr<ISyncWireTransport> accept() override
+    {
+        return this->accept(std::stop_token{});
+    }
+    virtual std::unique_ptr<ISyncWireTransport> accept(std::stop_token stoken) override
+    {
+        while (true) {
+            try {
+                if (!detail::waitFd(this->fd, POLLIN, this->wake_fd, std::chrono::years(1), stoken))
+                    return nullptr;
+            }
+            catch (TransportTimeoutException const&) {
+                continue;
+            }
+            auto const conn = ::accept4(this->fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (conn >= 0) {
+                if (this->options.log)
+                    LOG_NOISE(this, "accepted connection");
+                return std::make_unique<TcpTransport>(conn, this->options);
+            }
+            if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN)
+                detail::throwErrno("accept");
+        }
+    }
+
+private:
+    TcpTransportOptions options;
+    int fd = -1;
+    int wake_fd = -1;
+};
+
+std::unique_ptr<ISyncWireTransport> makeSyncTcpTransport(std::string_view remote_host, uint16_t remote_port, TcpTransportOptions const& options)
+{
+    if (options.max_message_size > UINT16_MAX)
+        throw MessageSizeException("TCP transport max_message_size must fit in 16 bits");
+    auto const ai = resolve(remote_host, remote_port, false);
+    int err = 0;
+    for (auto const* a = ai.get(); a; a = a->ai_next) {
+        auto const fd = ::socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+        if (fd < 0) {
+            err = errno;
+            continue;
+        }
+        if (::connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+            return std::make_unique<TcpTransport>(fd, options);
+        }
+        err = errno;
+        ::close(fd);
+    }
+    throw std::system_error(err, std::system_category(), std::format("connect({}:{})", remote_host, remote_port));
+}
+std::unique_ptr<ISyncWireListener> makeSyncTcpListener(std::string_view local_host, uint16_t local_port, TcpTransportOptions const& options)
+{
+    if (options.max_message_size > UINT16_MAX)
+        throw MessageSizeException("TCP transport max_message_size must fit in 16 bits");
+    return std::make_unique<TcpListener>(local_host, local_port, options);
+}
+
+}
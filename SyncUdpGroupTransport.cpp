@@ -0,0 +1,118 @@
+#include "Transports.h"
+#include "FdWait.h"
+#include "UdpMtu.h"
+#include <YALF/YALF.h>
+#include <algorithm>
+#include <asio.hpp>
+#include <format>
+#include <string>
+#include <vector>
+
+namespace RAP::Transport {
+
+// An unconnected UDP socket that sends every message to the group address and receives the members'
+// unicast replies, telling members apart by source endpoint.  recv() runs on the calling thread.
+class UdpGroupTransport : public ISyncGroupTransport
+{
+public:
+    UdpGroupTransport(std::string_view group_host, uint16_t group_port, std::vector<std::pair<std::string, uint16_t>> const& members_, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options)
+        : timeout(std::chrono::seconds(1))
+        , io_ctx()
+        , group_ep(this->resolveEndpoint(group_host, group_port))
+        , io_socket(this->io_ctx)
+        , max_message_size(detail::udpMaxMessageSize(this->io_ctx, this->group_ep, options))
+        , log(options.log)
+    {
+        for (auto const& [host, port] : members_)
+            this->members.push_back(this->resolveEndpoint(host, port));
+        auto const local_ep = local_host.empty() ? asio::ip::udp::endpoint{ this->group_ep.protocol(), local_port } : this->resolveEndpoint(local_host, local_port);
+        this->io_socket.open(local_ep.protocol());
+        this->io_socket.bind(local_ep);
+        if (this->group_ep.address().is_multicast()) {
+            if (!options.multicast_interface.empty())
+                this->io_socket.set_option(asio::ip::multicast::outbound_interface(asio::ip::make_address_v4(options.multicast_interface)));
+            // Members on this host hear the group too.
+            this->io_socket.set_option(asio::ip::multicast::enable_loopback(true));
+        }
+        else {
+            this->io_socket.set_option(asio::socket_base::broadcast(true));
+        }
+    }
+    static std::string_view getDomain() { return "UdpGroupTransport"; }
+
+    virtual void send(BufferView buffer) override
+    {
+        if (log) {
+            std::string data_str;
+            for (auto const d : buffer)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "send >>> [ {}]", data_str);
+        }
+        if (buffer.size() > this->max_message_size)
+            throw MessageSizeException("Message exceeds the transport's max_message_size");
+        this->io_socket.send_to(asio::buffer(buffer.data(), buffer.size()), this->group_ep);
+    }
+    virtual size_t recv(std::span<uint8_t> buffer, size_t& member) override
+    {
+        auto const deadline = std::chrono::steady_clock::now() + this->timeout;
+        while (true) {
+            auto const remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+            detail::waitFd(this->io_socket.native_handle(), POLLIN, -1, remaining, {});
+            asio::ip::udp::endpoint sender;
+            std::error_code ec;
+            auto const recvd_bytes = this->io_socket.receive_from(asio::buffer(buffer.data(), buffer.size()), sender, 0, ec);
+            // An ICMP error from a member that is down; its missing reply is reported by the caller.
+            if (ec == asio::error::connection_refused)
+                continue;
+            if (ec)
+                throw std::system_error(ec);
+            auto const it = std::find(this->members.begin(), this->members.end(), sender);
+            if (it == this->members.end())
+                continue;
+            member = it - this->members.begin();
+            if (log) {
+                std::string data_str;
+                for (auto const d : buffer.first(recvd_bytes))
+                    std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+                LOG_NOISE(this, "recv <<< [{}] [ {}]", member, data_str);
+            }
+            return recvd_bytes;
+        }
+    }
+    virtual size_t getMemberCount() const override
+    {
+        return this->members.size();
+    }
+    virtual uint16_t getMaxMessageSize() const override
+    {
+        return this->max_message_size;
+    }
+    virtual void setTimeout(std::chrono::microseconds new_timeout) override
+    {
+        this->timeout = new_timeout;
+    }
+
+private:
+    asio::ip::udp::endpoint resolveEndpoint(std::string_view host, uint16_t port)
+    {
+        asio::ip::udp::resolver resolver{ this->io_ctx };
+        auto const endpoints = resolver.resolve(host, std::format("{}", port));
+        return *endpoints.begin();
+    }
+
+private:
+    std::chrono::microseconds timeout;
+    asio::io_context io_ctx;
+    asio::ip::udp::endpoint group_ep;
+    asio::ip::udp::socket io_socket;
+    size_t max_message_size;
+    std::vector<asio::ip::udp::endpoint> members;
+    bool log;
+};
+
+std::unique_ptr<ISyncGroupTransport> makeSyncUdpGroupTransport(std::string_view group_host, uint16_t group_port, std::vector<std::pair<std::string, uint16_t>> const& members, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options)
+{
+    return std::make_unique<UdpGroupTransport>(group_host, group_port, members, local_host, local_port, options);
+}
+
+}
@@ -1,24 +1,66 @@
 #include "Transports.h"
+#include "BufferPool.h"
+#include "UdpMtu.h"
 #include <YALF/YALF.h>
+#include <array>
 #include <asio.hpp>
+#include <condition_variable>
 #include <format>
 #include <memory>
+#include <mutex>
+#include <thread>
+#if defined(__linux__)
+#include "FdWait.h"
+#include "SpscRing.h"
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#endif
 
 namespace RAP::Transport {
 
+// Receives are serviced by a reactor thread that owns the io_context for the lifetime of the transport.
+// It keeps one receive posted on the socket at all times and queues completed datagrams for recv().
+// In busy-poll mode there is no reactor; recv() polls the socket itself, which avoids a thread wakeup per datagram.
 class UdpTransport : public ISyncWireTransport
 {
+private:
+    // Datagrams beyond this many unclaimed ones are dropped, as a full socket buffer would.
+    static constexpr size_t MaxQueuedDatagrams = 256;
 public:
-    UdpTransport(std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, size_t mtu, bool log_)
+    UdpTransport(std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options)
         : timeout(std::chrono::seconds(1))
         , io_ctx()
         , io_remote_ep(this->resolveEndpoint(remote_host, remote_port))
         , io_local_ep(this->resolveEndpoint(local_host, local_port))
-        , max_message_size(mtu - /*IPv6*/40 - /*UDP*/8)
-        , io_socket(this->io_ctx, this->io_local_ep)
-        , log(log_)
+        , io_socket(this->connectSocket(options))
+        , max_message_size(detail::udpMaxMessageSize(this->io_socket, options))
+        , rx_buffer(this->max_message_size)
+        , pool(this->max_message_size, 8)
+        , group_member(!options.multicast_group.empty())
+        , busy_poll(options.busy_poll)
+        , busy_poll_spin(options.busy_poll_spin)
+        , log(options.log)
     {
-        this->io_socket.connect(this->io_remote_ep);
+        if (this->busy_poll) {
+            if (this->group_member)
+                throw Exception("UDP busy-poll mode cannot be combined with multicast_group");
+            this->setupBusyPoll(options);
+            return;
+        }
+        this->startReceive();
+        this->reactor = std::jthread([this] {
+            this->io_ctx.run();
+        });
+    }
+    ~UdpTransport()
+    {
+        this->io_ctx.stop();
+#if defined(__linux__)
+        if (this->wake_fd >= 0)
+            ::close(this->wake_fd);
+#endif
     }
     static std::string_view getDomain() { return "UdpTransport"; }
 
@@ -30,39 +72,65 @@ public:
                 std::format_to(std::back_inserter(data_str), "{:02x} ", d);
             LOG_NOISE(this, "send >>> [ {}]", data_str);
         }
-        this->io_socket.send(asio::buffer(buffer.data(), buffer.size()));
+        // A synchronous send only issues the send syscall; it does not interact with the receive pending on the reactor.
+        if (this->group_member)
+            this->io_socket.send_to(asio::buffer(buffer.data(), buffer.size()), this->io_remote_ep);
+        else
+            this->io_socket.send(asio::buffer(buffer.data(), buffer.size()));
     }
-    virtual Buffer recv() override
+    virtual void send(std::span<BufferView const> parts) override
     {
-        Buffer buffer(this->max_message_size);
-        auto const received_bytes = this->io_socket.receive(asio::buffer(buffer));
-        buffer.resize(received_bytes);
+        // One datagram gathered straight from the parts; longer lists take the copying path.
+        std::array<asio::const_buffer, 4> buffers;
+        if (parts.size() > buffers.size())
+            return ISyncWireTransport::send(parts);
         if (log) {
             std::string data_str;
-            for (auto const d : buffer)
-                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
-            LOG_NOISE(this, "recv <<< [ {}]", data_str);
+            for (auto const part : parts)
+                for (auto const d : part)
+                    std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "send >>> [ {}]", data_str);
+        }
+        for (size_t i = 0; i < parts.size(); i++)
+            buffers[i] = asio::buffer(parts[i].data(), parts[i].size());
+        if (this->group_member)
+            this->io_socket.send_to(std::span{ buffers }.first(parts.size()), this->io_remote_ep);
+        else
+            this->io_socket.send(std::span{ buffers }.first(parts.size()));
+    }
+    virtual Buffer recv() override
+    {
+        if (this->busy_poll) {
+            Buffer buffer(this->max_message_size);
+            buffer.resize(this->pollReceive(buffer, {}));
+            return buffer;
         }
-        return buffer;
+        auto const pooled = this->pop();
+        return *pooled;
     }
     virtual Buffer recv(std::stop_token stoken) override
     {
-        Buffer buffer(this->max_message_size);
-        size_t received_bytes = 0;
-        this->io_socket.async_receive(asio::buffer(buffer), [&](std::error_code const& ec, size_t recvd_bytes) {
-            if (ec)
-                throw ec;
-            received_bytes = recvd_bytes;
-        });
-        this->run(this->timeout, stoken);
-        buffer.resize(received_bytes);
-        if (log) {
-            std::string data_str;
-            for (auto const d : buffer)
-                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
-            LOG_NOISE(this, "recv <<< [ {}]", data_str);
+        if (this->busy_poll) {
+            Buffer buffer(this->max_message_size);
+            buffer.resize(this->pollReceive(buffer, stoken));
+            return buffer;
         }
-        return buffer;
+        auto const pooled = this->pop(stoken);
+        return *pooled;
+    }
+    virtual size_t recv(std::span<uint8_t> buffer) override
+    {
+        if (this->busy_poll)
+            return this->pollReceive(buffer, {});
+        auto const pooled = this->pop();
+        return this->copyOut(*pooled, buffer);
+    }
+    virtual size_t recv(std::span<uint8_t> buffer, std::stop_token stoken) override
+    {
+        if (this->busy_poll)
+            return this->pollReceive(buffer, stoken);
+        auto const pooled = this->pop(stoken);
+        return this->copyOut(*pooled, buffer);
     }
     virtual uint16_t getMaxMessageSize() const override
     {
@@ -72,6 +140,10 @@ public:
     {
         this->timeout = new_timeout;
     }
+    virtual std::optional<std::chrono::microseconds> getTimeout() const override
+    {
+        return this->timeout;
+    }
 
 private:
     asio::ip::udp::endpoint resolveEndpoint(std::string_view host, uint16_t port)
@@ -80,32 +152,211 @@ private:
         auto const endpoints = resolver.resolve(host, std::format("{}", port));
         return *endpoints.begin();
     }
-    void run(std::chrono::microseconds timeout, std::stop_token stoken)
+    asio::ip::udp::socket connectSocket(UdpTransportOptions const& options)
+    {
+        asio::ip::udp::socket socket{ this->io_ctx, this->io_local_ep.protocol() };
+        if (!options.multicast_group.empty()) {
+            // Every member of the group on this host binds the group's port.  The socket is left unconnected:
+            // connecting would fix its local address to a unicast one, and datagrams sent to the group would no longer match.
+            socket.set_option(asio::socket_base::reuse_address(true));
+            auto const group = asio::ip::make_address(options.multicast_group);
+            if (group.is_v4() && !options.multicast_interface.empty())
+                socket.set_option(asio::ip::multicast::join_group(group.to_v4(), asio::ip::make_address_v4(options.multicast_interface)));
+            else
+                socket.set_option(asio::ip::multicast::join_group(group));
+        }
+        socket.bind(this->io_local_ep);
+        if (options.multicast_group.empty())
+            socket.connect(this->io_remote_ep);
+        return socket;
+    }
+    // Runs on the reactor thread only.
+    void startReceive()
     {
-        this->io_ctx.restart();
-        auto stop_callback = std::stop_callback(stoken, [&] {
-            io_socket.cancel();
-            io_ctx.stop();
+        this->io_socket.async_receive_from(asio::buffer(this->rx_buffer), this->rx_sender, [this](std::error_code const& ec, size_t recvd_bytes) {
+            if (ec == asio::error::operation_aborted)
+                return;
+            // A group member's socket is not connected, so it filters out other senders itself.
+            if (!ec && this->group_member && this->rx_sender != this->io_remote_ep) {
+                this->startReceive();
+                return;
+            }
+            auto const rearm = !ec || isTransientError(ec);
+            {
+                std::lock_guard lg{ this->mtx };
+                if (ec) {
+                    this->error = ec;
+                    this->receive_failed = !rearm;
+                }
+                else if (this->queue.size() < MaxQueuedDatagrams) {
+                    auto pooled = this->pool.lease();
+                    pooled->assign(this->rx_buffer.begin(), this->rx_buffer.begin() + recvd_bytes);
+                    this->queue.push(std::move(pooled));
+                }
+            }
+            this->cv.notify_one();
+            // Any other error would most likely repeat at once and keep the reactor spinning.
+            if (rearm)
+                this->startReceive();
         });
-        this->io_ctx.run_for(timeout);
-        if (!this->io_ctx.stopped()) {
-            this->io_socket.cancel();
-            this->io_ctx.run();
+    }
+    // Errors that concern one datagram, or are reported through ICMP for an earlier send, and leave the socket usable.
+    static bool isTransientError(std::error_code const& ec)
+    {
+        return ec == asio::error::connection_refused || ec == asio::error::connection_reset
+            || ec == asio::error::host_unreachable || ec == asio::error::network_unreachable
+            || ec == asio::error::message_size || ec == asio::error::no_buffer_space
+            || ec == asio::error::interrupted || ec == asio::error::would_block || ec == asio::error::try_again;
+    }
+    PooledBuffer pop()
+    {
+        std::unique_lock lk{ this->mtx };
+        this->cv.wait_for(lk, this->timeout, [&] {
+            return !this->queue.empty() || this->error;
+        });
+        return this->popLocked();
+    }
+    PooledBuffer pop(std::stop_token stoken)
+    {
+        std::unique_lock lk{ this->mtx };
+        this->cv.wait_for(lk, stoken, this->timeout, [&] {
+            return !this->queue.empty() || this->error;
+        });
+        if (stoken.stop_requested())
+            return PooledBuffer{};
+        return this->popLocked();
+    }
+    // Must be called with `mtx` held.
+    PooledBuffer popLocked()
+    {
+        // Once receiving has stopped, every later receive reports the error that stopped it.
+        if (this->error)
+            throw std::system_error(this->receive_failed ? this->error : std::exchange(this->error, {}));
+        if (this->queue.empty())
+            throw TransportTimeoutException();
+        auto pooled = this->queue.pop();
+        if (log) {
+            std::string data_str;
+            for (auto const d : *pooled)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "recv <<< [ {}]", data_str);
+        }
+        return pooled;
+    }
+#if defined(__linux__)
+    void setupBusyPoll(UdpTransportOptions const& options)
+    {
+        this->wake_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (this->wake_fd < 0)
+            detail::throwErrno("eventfd");
+        if (options.so_busy_poll_us != 0) {
+            int const us = static_cast<int>(options.so_busy_poll_us);
+            // Raising it above net.core.busy_read needs CAP_NET_ADMIN.
+            if (::setsockopt(this->io_socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) != 0)
+                detail::throwErrno("setsockopt(SO_BUSY_POLL)");
         }
     }
+    // Receives straight into `buffer`: spins on non-blocking receives for up to busy_poll_spin, then blocks in ppoll.
+    size_t pollReceive(std::span<uint8_t> buffer, std::stop_token stoken)
+    {
+        auto const fd = this->io_socket.native_handle();
+        auto const start = std::chrono::steady_clock::now();
+        auto const deadline = start + this->timeout;
+        auto const spin_until = start + this->busy_poll_spin;
+        while (true) {
+            // MSG_TRUNC reports the full length of a datagram that did not fit.
+            auto const n = ::recv(fd, buffer.data(), buffer.size(), MSG_DONTWAIT | MSG_TRUNC);
+            if (n >= 0) {
+                if (static_cast<size_t>(n) > buffer.size())
+                    throw MessageSizeException("Received message does not fit in the supplied buffer");
+                if (log) {
+                    std::string data_str;
+                    for (auto const d : buffer.first(n))
+                        std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+                    LOG_NOISE(this, "recv <<< [ {}]", data_str);
+                }
+                return n;
+            }
+            if (errno != EAGAIN && errno != EINTR)
+                detail::throwErrno("recv");
+            if (stoken.stop_requested())
+                return 0;
+            auto const now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+                throw TransportTimeoutException();
+            if (now < spin_until) {
+                cpuRelax();
+                continue;
+            }
+            if (!detail::waitFd(fd, POLLIN, this->wake_fd, std::chrono::duration_cast<std::chrono::microseconds>(deadline - now), stoken))
+                return 0;
+        }
+    }
+#else
+    void setupBusyPoll(UdpTransportOptions const&)
+    {
+        throw Exception("UDP busy-poll mode is only supported on Linux");
+    }
+    size_t pollReceive(std::span<uint8_t>, std::stop_token)
+    {
+        return 0;
+    }
+#endif
+    size_t copyOut(Buffer const& message, std::span<uint8_t> buffer)
+    {
+        if (message.size() > buffer.size())
+            throw MessageSizeException("Received message does not fit in the supplied buffer");
+        std::copy(message.begin(), message.end(), buffer.begin());
+        return message.size();
+    }
 private:
     std::chrono::microseconds timeout;
     asio::io_context io_ctx;
     asio::ip::udp::endpoint io_remote_ep;
     asio::ip::udp::endpoint io_local_ep;
-    size_t max_message_size;
     asio::ip::udp::socket io_socket;
+    // Only touched by the reactor thread.
+    asio::ip::udp::endpoint rx_sender;
+    size_t max_message_size;
+    Buffer rx_buffer;
+    // Declared before `queue`, whose buffers are returned to it on destruction.
+    BufferPool pool;
+    bool group_member;
+    bool busy_poll;
+    std::chrono::microseconds busy_poll_spin;
+    int wake_fd = -1;
     bool log;
+
+    std::mutex mtx;
+    std::condition_variable_any cv;
+    PooledBufferQueue queue;
+    std::error_code error;
+    // Set when `error` ended the reactor's receive loop.
+    bool receive_failed = false;
+
+    std::jthread reactor;
 };
 
 std::unique_ptr<ISyncWireTransport> makeSyncUdpTransport(std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, bool log)
 {
-    return std::make_unique<UdpTransport>(remote_host, remote_port, local_host, local_port, 1500, log);
+    return makeSyncUdpTransport(remote_host, remote_port, local_host, local_port, UdpTransportOptions{ .log = log });
+}
+std::unique_ptr<ISyncWireTransport> makeSyncUdpTransport(std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options)
+{
+    return std::make_unique<UdpTransport>(remote_host, remote_port, local_host, local_port, options);
+}
+
+void pinCurrentThreadToCpu(unsigned cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (auto const rc = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set); rc != 0)
+        throw std::system_error(rc, std::system_category(), std::format("pthread_setaffinity_np(cpu {})", cpu));
+#else
+    throw Exception("pinCurrentThreadToCpu is only supported on Linux");
+#endif
 }
 
 }
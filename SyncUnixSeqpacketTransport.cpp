@@ -0,0 +1,252 @@
+#include "Transports.h"
+#include "FdWait.h"
+#include <YALF/YALF.h>
+#include <array>
+#include <cerrno>
+#include <format>
+#include <string>
+#include <system_error>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace RAP::Transport {
+
+namespace {
+
+sockaddr_un makeAddress(std::string_view path)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        throw Exception(std::format("Unix socket path too long: {}", path));
+    path.copy(addr.sun_path, path.size());
+    return addr;
+}
+
+}
+
+// A connected AF_UNIX SOCK_SEQPACKET socket, which preserves message boundaries.
+class UnixSeqpacketTransport : public ISyncWireTransport
+{
+public:
+    UnixSeqpacketTransport(int fd_, size_t max_message_size_, bool log_)
+        : fd(fd_)
+        , wake_fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+        , max_message_size(max_message_size_)
+        , timeout(std::chrono::seconds(1))
+        , log(log_)
+    {
+        if (this->wake_fd < 0) {
+            ::close(this->fd);
+            detail::throwErrno("eventfd");
+        }
+    }
+    ~UnixSeqpacketTransport()
+    {
+        ::close(this->wake_fd);
+        ::close(this->fd);
+    }
+    static std::string_view getDomain() { return "UnixSeqpacketTransport"; }
+
+    virtual void send(BufferView buffer) override
+    {
+        if (log) {
+            std::string data_str;
+            for (auto const d : buffer)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "send >>> [ {}]", data_str);
+        }
+        if (buffer.size() > this->max_message_size)
+            throw MessageSizeException("Message exceeds the transport's max_message_size");
+        while (::send(this->fd, buffer.data(), buffer.size(), MSG_NOSIGNAL) < 0) {
+            if (errno == EPIPE || errno == ECONNRESET)
+                throw TransportClosedException();
+            if (errno != EINTR)
+                detail::throwErrno("send");
+        }
+    }
+    virtual void send(std::span<BufferView const> parts) override
+    {
+        // One packet gathered straight from the parts; longer lists take the copying path.
+        std::array<iovec, 4> iov;
+        if (parts.size() > iov.size())
+            return ISyncWireTransport::send(parts);
+        if (log) {
+            std::string data_str;
+            for (auto const part : parts)
+                for (auto const d : part)
+                    std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "send >>> [ {}]", data_str);
+        }
+        size_t size = 0;
+        for (size_t i = 0; i < parts.size(); i++) {
+            iov[i] = iovec{ .iov_base = const_cast<uint8_t*>(parts[i].data()), .iov_len = parts[i].size() };
+            size += parts[i].size();
+        }
+        if (size > this->max_message_size)
+            throw MessageSizeException("Message exceeds the transport's max_message_size");
+        msghdr msg{};
+        msg.msg_iov = iov.data();
+        msg.msg_iovlen = parts.size();
+        while (::sendmsg(this->fd, &msg, MSG_NOSIGNAL) < 0) {
+            if (errno == EPIPE || errno == ECONNRESET)
+                throw TransportClosedException();
+            if (errno != EINTR)
+                detail::throwErrno("sendmsg");
+        }
+    }
+    virtual Buffer recv() override
+    {
+        return this->recv(std::stop_token{});
+    }
+    virtual Buffer recv(std::stop_token stoken) override
+    {
+        Buffer buffer(this->max_message_size);
+        buffer.resize(this->recv(buffer, stoken));
+        return buffer;
+    }
+    virtual size_t recv(std::span<uint8_t> buffer) override
+    {
+        return this->recv(buffer, std::stop_token{});
+    }
+    virtual size_t recv(std::span<uint8_t> buffer, std::stop_token stoken) override
+    {
+        if (!detail::waitFd(this->fd, POLLIN, this->wake_fd, this->timeout, stoken))
+            return 0;
+        ssize_t received_bytes;
+        // MSG_TRUNC reports the full length of a message that did not fit.
+        while ((received_bytes = ::recv(this->fd, buffer.data(), buffer.size(), MSG_TRUNC)) < 0) {
+            if (errno == ECONNRESET)
+                throw TransportClosedException();
+            if (errno != EINTR)
+                detail::throwErrno("recv");
+        }
+        if (received_bytes == 0)
+            throw TransportClosedException();
+        if (static_cast<size_t>(received_bytes) > buffer.size())
+            throw MessageSizeException("Received message does not fit in the supplied buffer");
+        if (log) {
+            std::string data_str;
+            for (auto const d : buffer.first(received_bytes))
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "recv <<< [ {}]", data_str);
+        }
+        return received_bytes;
+    }
+    virtual uint16_t getMaxMessageSize() const override
+    {
+        return static_cast<uint16_t>(this->max_message_size);
+    }
+    virtual void setTimeout(std::chrono::microseconds new_timeout) override
+    {
+        this->timeout = new_timeout;
+    }
+    virtual std::optional<std::chrono::microseconds> getTimeout() const override
+    {
+        return this->timeout;
+    }
+
+private:
+    int fd;
+    int wake_fd;
+    size_t max_message_size;
+    std::chrono::microseconds timeout;
+    bool log;
+};
+
+class UnixSeqpacketListener : public ISyncWireListener
+{
+public:
+    UnixSeqpacketListener(std::string_view path_, size_t max_message_size_, bool log_)
+        : path(path_)
+        , max_message_size(max_message_size_)
+        , log(log_)
+    {
+        auto const addr = makeAddress(this->path);
+        // Non-blocking, so accept() cannot hang on a connection that was aborted after ppoll reported it.
+        this->fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (this->fd < 0)
+            detail::throwErrno("socket");
+        this->wake_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (this->wake_fd < 0) {
+            ::close(this->fd);
+            detail::throwErrno("eventfd");
+        }
+        // Remove a socket file left behind by a previous server, but nothing else that happens to have the name.
+        struct stat st{};
+        if (::lstat(this->path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            ::unlink(this->path.c_str());
+        if (::bind(this->fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0 || ::listen(this->fd, SOMAXCONN) != 0) {
+            auto const err = errno;
+            ::close(this->wake_fd);
+            ::close(this->fd);
+            throw std::system_error(err, std::system_category(), std::format("bind/listen({})", this->path));
+        }
+    }
+    ~UnixSeqpacketListener()
+    {
+        ::close(this->wake_fd);
+        ::close(this->fd);
+        ::unlink(this->path.c_str());
+    }
+    static std::string_view getDomain() { return "UnixSeqpacketListener"; }
+
+    virtual std::unique_ptr<ISyncWireTransport> accept() override
+    {
+        return this->accept(std::stop_token{});
+    }
+    virtual std::unique_ptr<ISyncWireTransport> accept(std::stop_token stoken) override
+    {
+        while (true) {
+            try {
+                if (!detail::waitFd(this->fd, POLLIN, this->wake_fd, std::chrono::years(1), stoken))
+                    return nullptr;
+            }
+            catch (TransportTimeoutException const&) {
+                continue;
+            }
+            auto const conn = ::accept4(this->fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (conn >= 0) {
+                if (this->log)
+                    LOG_NOISE(this, "accepted connection on {}", this->path);
+                return std::make_unique<UnixSeqpacketTransport>(conn, this->max_message_size, this->log);
+            }
+            if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN)
+                detail::throwErrno("accept");
+        }
+    }
+
+private:
+    std::string path;
+    size_t max_message_size;
+    bool log;
+    int fd = -1;
+    int wake_fd = -1;
+};
+
+std::unique_ptr<ISyncWireTransport> makeSyncUnixSeqpacketTransport(std::string_view path, size_t max_message_size, bool log)
+{
+    if (max_message_size > UINT16_MAX)
+        throw MessageSizeException("Unix seqpacket transport max_message_size must fit in 16 bits");
+    auto const addr = makeAddress(path);
+    auto const fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        detail::throwErrno("socket");
+    if (::connect(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0) {
+        auto const err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::system_category(), std::format("connect({})", path));
+    }
+    return std::make_unique<UnixSeqpacketTransport>(fd, max_message_size, log);
+}
+std::unique_ptr<ISyncWireListener> makeSyncUnixSeqpacketListener(std::string_view path, size_t max_message_size, bool log)
+{
+    if (max_message_size > UINT16_MAX)
+        throw MessageSizeException("Unix seqpacket transport max_message_size must fit in 16 bits");
+    return std::make_unique<UnixSeqpacketListener>(path, max_message_size, log);
+}
+
+}
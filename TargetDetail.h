@@ -0,0 +1,67 @@
+#pragma once
+#include "Types.h"
+#include "Configuration.h"
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <vector>
+
+// Shared by the register targets.
+namespace RAP::RTF::detail {
+
+// Splits an operation on `total` items into as few messages as the transport allows,
+// calling fn(offset, count) for each in order.
+template <typename Fn>
+void forEachChunk(size_t total, size_t max_per_message, Fn&& fn)
+{
+    if (max_per_message == 0 && total != 0)
+        throw MessageSizeException("The transport's max message size leaves no room for a single item");
+    for (size_t offset = 0; offset < total; offset += max_per_message)
+        fn(offset, std::min(max_per_message, total - offset));
+}
+
+// True if a sequential operation with this address increment can be sent as one command.
+template <IsConfigurationType Cfg>
+constexpr bool checkIFS(size_t increment)
+{
+    if (Cfg::FeatureIncrement)
+        return true;
+    if (increment == 0 && Cfg::FeatureFifo)
+        return true;
+    if (increment == sizeof(typename Cfg::DataType) && Cfg::FeatureSequential)
+        return true;
+    return false;
+}
+
+// Runs fn(0) on the calling thread and fn(1) .. fn(count - 1) on their own tasks, then rethrows the first error.
+template <typename Fn>
+void runParallel(size_t count, Fn&& fn)
+{
+    std::vector<std::future<void>> futures;
+    futures.reserve(count > 0 ? count - 1 : 0);
+    for (size_t i = 1; i < count; i++)
+        futures.push_back(std::async(std::launch::async, [&fn, i] { fn(i); }));
+    std::exception_ptr first_error;
+    try {
+        if (count > 0)
+            fn(0);
+    }
+    catch (...) {
+        first_error = std::current_exception();
+    }
+    // Every task must finish before returning, since they reference the caller's buffers.
+    for (auto& f : futures) {
+        try {
+            f.get();
+        }
+        catch (...) {
+            if (!first_error)
+                first_error = std::current_exception();
+        }
+    }
+    if (first_error)
+        std::rethrow_exception(first_error);
+}
+
+}
@@ -0,0 +1,198 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <future>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace RAP::Async {
+
+template <typename T>
+class Task;
+
+namespace detail {
+
+template <typename T>
+class TaskPromiseBase
+{
+public:
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            if (auto const continuation = handle.promise().continuation)
+                return continuation;
+            return std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { this->result.template emplace<2>(std::current_exception()); }
+
+    std::coroutine_handle<> continuation;
+protected:
+    std::variant<std::monostate, T, std::exception_ptr> result;
+};
+
+}
+
+// A lazily started coroutine producing a T.
+// The body starts running when the Task is co_await'ed and the awaiting coroutine is resumed
+// (via symmetric transfer) on whichever thread completes the Task.
+template <typename T = void>
+class [[nodiscard]] Task
+{
+public:
+    class promise_type : public detail::TaskPromiseBase<T>
+    {
+    public:
+        Task get_return_object() { return Task{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        template <typename U>
+        void return_value(U&& value) { this->result.template emplace<1>(std::forward<U>(value)); }
+        T take()
+        {
+            if (this->result.index() == 2)
+                std::rethrow_exception(std::get<2>(this->result));
+            return std::move(std::get<1>(this->result));
+        }
+    };
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other) {
+            if (this->handle)
+                this->handle.destroy();
+            this->handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    ~Task()
+    {
+        if (this->handle)
+            this->handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+    {
+        this->handle.promise().continuation = continuation;
+        return this->handle;
+    }
+    T await_resume() { return this->handle.promise().take(); }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle_) : handle(handle_) {}
+    std::coroutine_handle<promise_type> handle;
+};
+
+template <>
+class [[nodiscard]] Task<void>
+{
+public:
+    class promise_type : public detail::TaskPromiseBase<std::monostate>
+    {
+    public:
+        Task get_return_object() { return Task{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        void return_void() { this->result.emplace<1>(); }
+        void take()
+        {
+            if (this->result.index() == 2)
+                std::rethrow_exception(std::get<2>(this->result));
+        }
+    };
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other) {
+            if (this->handle)
+                this->handle.destroy();
+            this->handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    ~Task()
+    {
+        if (this->handle)
+            this->handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+    {
+        this->handle.promise().continuation = continuation;
+        return this->handle;
+    }
+    void await_resume() { this->handle.promise().take(); }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle_) : handle(handle_) {}
+    std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+
+// Eagerly started, self-destroying coroutine used to run a Task to completion.
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+inline DetachedTask runDetached(Task<void> task, std::function<void(std::exception_ptr)> on_error)
+{
+    try {
+        co_await std::move(task);
+    }
+    catch (...) {
+        if (on_error)
+            on_error(std::current_exception());
+    }
+}
+
+template <typename T>
+DetachedTask runToPromise(Task<T> task, std::promise<T> promise)
+{
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(task);
+            promise.set_value();
+        }
+        else {
+            promise.set_value(co_await std::move(task));
+        }
+    }
+    catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+}
+
+// Start a task without waiting for it.  Exceptions escaping the task are passed to on_error, if given.
+inline void spawn(Task<void> task, std::function<void(std::exception_ptr)> on_error = {})
+{
+    detail::runDetached(std::move(task), std::move(on_error));
+}
+
+// Start a task and block the calling thread until it completes.
+// The io_context driving the task's I/O must be run by another thread.
+template <typename T>
+T syncWait(Task<T> task)
+{
+    std::promise<T> promise;
+    auto future = promise.get_future();
+    detail::runToPromise(std::move(task), std::move(promise));
+    return future.get();
+}
+
+}
@@ -1,8 +1,25 @@
 #pragma once
 #include "Types.h"
+#include <algorithm>
 #include <chrono>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
 #include <stdexcept>
 #include <stop_token>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace asio {
+class io_context;
+}
+namespace RAP {
+class TransportStats;
+}
 
 namespace RAP::Transport {
 
@@ -11,17 +28,266 @@ class TransportTimeoutException : public RAP::Exception
 public:
     TransportTimeoutException() : Exception("Transport operation timed out!") {}
 };
+class TransportCancelledException : public RAP::Exception
+{
+public:
+    TransportCancelledException() : Exception("Transport operation was cancelled!") {}
+};
+class TransportClosedException : public RAP::Exception
+{
+public:
+    TransportClosedException() : Exception("Transport connection was closed by the peer!") {}
+};
 class ISyncWireTransport {
 public:
     virtual ~ISyncWireTransport() = default;
     virtual void send(BufferView buffer) = 0;
+    // Sends the concatenation of `parts` as one message, e.g. a header, a payload referenced in place and a CRC.
+    // Socket-based transports gather the parts in the kernel; the default copies them into one buffer first.
+    virtual void send(std::span<BufferView const> parts)
+    {
+        Buffer buffer;
+        for (auto const part : parts)
+            buffer.insert(buffer.end(), part.begin(), part.end());
+        this->send(BufferView{ buffer });
+    }
     virtual Buffer recv() = 0;
     virtual Buffer recv(std::stop_token stoken) = 0;
+    // Receive into a caller-supplied buffer, which should hold getMaxMessageSize() bytes, and return the message size.
+    // Throws MessageSizeException if the message does not fit.  The stop_token form returns 0 when stopped.
+    // The defaults copy what recv() returns; built-in transports receive in place.
+    virtual size_t recv(std::span<uint8_t> buffer)
+    {
+        return copyMessage(this->recv(), buffer);
+    }
+    virtual size_t recv(std::span<uint8_t> buffer, std::stop_token stoken)
+    {
+        return copyMessage(this->recv(stoken), buffer);
+    }
+    virtual uint16_t getMaxMessageSize() const = 0;
+    virtual void setTimeout(std::chrono::microseconds timeout) = 0;
+    // The timeout last set, or nullopt if the transport does not report it.
+    virtual std::optional<std::chrono::microseconds> getTimeout() const { return std::nullopt; }
+
+private:
+    static size_t copyMessage(BufferView message, std::span<uint8_t> buffer)
+    {
+        if (message.size() > buffer.size())
+            throw MessageSizeException("Received message does not fit in the supplied buffer");
+        std::ranges::copy(message, buffer.begin());
+        return message.size();
+    }
+};
+
+// Server side of connection-oriented transports: each accepted connection is its own ISyncWireTransport,
+// typically handed to a RapServerAdapter.
+class ISyncWireListener {
+public:
+    virtual ~ISyncWireListener() = default;
+    // Blocks until a client connects.
+    virtual std::unique_ptr<ISyncWireTransport> accept() = 0;
+    // Blocks until a client connects or the stop_token is signalled, in which case nullptr is returned.
+    virtual std::unique_ptr<ISyncWireTransport> accept(std::stop_token stoken) = 0;
+};
+
+// One-to-many datagram transport: each message is sent once to a multicast or broadcast group,
+// and the group's members reply individually.
+class ISyncGroupTransport {
+public:
+    virtual ~ISyncGroupTransport() = default;
+    virtual void send(BufferView buffer) = 0;
+    // Receives one reply and sets `member` to the index of its sender in the member list the transport was created with.
+    // Datagrams from anyone else are dropped.  Throws TransportTimeoutException if nothing arrives within the timeout.
+    virtual size_t recv(std::span<uint8_t> buffer, size_t& member) = 0;
+    virtual size_t getMemberCount() const = 0;
+    virtual uint16_t getMaxMessageSize() const = 0;
+    virtual void setTimeout(std::chrono::microseconds timeout) = 0;
+};
+
+class IAsyncWireTransport {
+public:
+    // Completion handlers are called on the thread running the transport's io_context.
+    // Errors (including TransportTimeoutException and TransportCancelledException) are passed as an exception_ptr.
+    using SendHandler = std::function<void(std::exception_ptr)>;
+    using RecvHandler = std::function<void(std::exception_ptr, Buffer)>;
+    class SendAwaitable;
+    class RecvAwaitable;
+
+    virtual ~IAsyncWireTransport() = default;
+    // The buffer is copied before asyncSend returns.
+    virtual void asyncSend(BufferView buffer, SendHandler handler) = 0;
+    // Pending receives complete in the order they were started, each with its own timeout.
+    virtual void asyncRecv(RecvHandler handler) = 0;
+    // Complete all pending receives with TransportCancelledException.
+    virtual void cancel() = 0;
     virtual uint16_t getMaxMessageSize() const = 0;
     virtual void setTimeout(std::chrono::microseconds timeout) = 0;
+
+    // Coroutine forms: `co_await transport.asyncSend(buffer)` and `Buffer b = co_await transport.asyncRecv()`.
+    // The awaiting coroutine is resumed on the io_context thread.
+    SendAwaitable asyncSend(BufferView buffer);
+    RecvAwaitable asyncRecv();
+};
+
+class IAsyncWireTransport::SendAwaitable {
+public:
+    SendAwaitable(IAsyncWireTransport& transport_, BufferView buffer_) : transport(transport_), buffer(buffer_) {}
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        this->transport.asyncSend(this->buffer, [this, handle](std::exception_ptr error_) {
+            this->error = error_;
+            handle.resume();
+        });
+    }
+    void await_resume() const
+    {
+        if (this->error)
+            std::rethrow_exception(this->error);
+    }
+private:
+    IAsyncWireTransport& transport;
+    BufferView buffer;
+    std::exception_ptr error;
 };
 
+class IAsyncWireTransport::RecvAwaitable {
+public:
+    explicit RecvAwaitable(IAsyncWireTransport& transport_) : transport(transport_) {}
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        this->transport.asyncRecv([this, handle](std::exception_ptr error_, Buffer buffer_) {
+            this->error = error_;
+            this->buffer = std::move(buffer_);
+            handle.resume();
+        });
+    }
+    Buffer await_resume()
+    {
+        if (this->error)
+            std::rethrow_exception(this->error);
+        return std::move(this->buffer);
+    }
+private:
+    IAsyncWireTransport& transport;
+    std::exception_ptr error;
+    Buffer buffer;
+};
+
+inline IAsyncWireTransport::SendAwaitable IAsyncWireTransport::asyncSend(BufferView buffer)
+{
+    return SendAwaitable{ *this, buffer };
+}
+inline IAsyncWireTransport::RecvAwaitable IAsyncWireTransport::asyncRecv()
+{
+    return RecvAwaitable{ *this };
+}
+
+struct UdpTransportOptions {
+    // The link MTU, e.g. 9000 on a jumbo-frame network.  Messages may be as large as fits in one packet
+    // after the IP (20 or 40 byte) and UDP (8 byte) headers, up to 65507 bytes over IPv4.
+    size_t mtu = 1500;
+    // Use the kernel's MTU for the route to the peer (IP_MTU) instead of `mtu`, where supported.
+    bool discover_path_mtu = false;
+    // Low-latency mode for makeSyncUdpTransport (Linux only): recv() polls the socket from the calling thread,
+    // spinning for up to busy_poll_spin before it blocks, instead of being handed datagrams by the reactor thread.
+    bool busy_poll = false;
+    std::chrono::microseconds busy_poll_spin = std::chrono::microseconds(200);
+    // SO_BUSY_POLL, in microseconds: the kernel also polls the NIC's receive queue for receives; 0 leaves it off.
+    unsigned so_busy_poll_us = 0;
+    // makeSyncUdpTransport only: join this multicast group, so that commands a controller sends to the group are received.
+    // Bind to the wildcard address (e.g. local_host "0.0.0.0") and the group's port; several transports on one host may share it.
+    std::string multicast_group;
+    // IPv4 address of the interface to join multicast groups on, and for makeSyncUdpGroupTransport to send on;
+    // empty lets the kernel choose by route.
+    std::string multicast_interface;
+    bool log = false;
+};
+
+// An io_uring instance (Linux 6.0+) with its own completion thread, shared by any number of io_uring transports.
+class UringContext;
+struct UringContextOptions {
+    // Submission queue entries; the completion queue is four times larger.
+    unsigned entries = 256;
+    // Have a kernel thread poll the submission queue, so that submitting usually needs no syscall.
+    // This costs a CPU while traffic is flowing and until the thread has been idle for sq_poll_idle.
+    bool sq_poll = false;
+    std::chrono::milliseconds sq_poll_idle = std::chrono::milliseconds(50);
+};
+
+// Simulated time for impaired transports; see VirtualClock.h.
+class VirtualClock;
+// What makeSyncImpairedTransport does to the messages sent through it.
+// Probabilities are per message, except bit_error_rate, which is per bit.
+struct ImpairmentOptions {
+    // One-way delay of every message, plus a uniformly distributed extra delay of up to `jitter`.
+    std::chrono::microseconds latency{ 0 };
+    std::chrono::microseconds jitter{ 0 };
+    // Link rate in bits per second: messages are serialized one after another.  0 means unlimited.
+    uint64_t bandwidth_bps = 0;
+    double loss = 0;
+    double duplicate = 0;
+    // Chance that a message is held back by an extra `reorder_delay`, so that later ones overtake it.
+    double reorder = 0;
+    std::chrono::microseconds reorder_delay{ 1000 };
+    // Flipped bits are left for the receiver's CRC check to catch.  Must be below 1.
+    double bit_error_rate = 0;
+    // Seeds the random choices, so that the same traffic is impaired the same way every time.
+    uint64_t seed = 0;
+    // Run on simulated rather than real time; share one clock between both ends of a link.
+    std::shared_ptr<VirtualClock> clock;
+};
+
+struct TcpTransportOptions {
+    // Up to 65535; messages are framed with a 16-bit length prefix.
+    size_t max_message_size = 16384;
+    // Disable Nagle's algorithm so each message is sent as soon as it is written.
+    bool no_delay = true;
+    // Queue sent messages and write them together once `batch_flush_bytes` are pending or when recv() would block.
+    // Useful for pipelined traffic, such as a server answering several queued commands.
+    bool batch_writes = false;
+    size_t batch_flush_bytes = 8192;
+    bool log = false;
+};
+
+// Each direction holds up to 64 messages.  When it is full, send() waits for the peer to receive for up to one second
+// (or the timeout, if shorter) and then throws TransportTimeoutException.
 std::pair<std::unique_ptr<ISyncWireTransport>, std::unique_ptr<ISyncWireTransport>> makeSyncPairedIpcTransport(size_t max_message_size = 512);
 std::unique_ptr<ISyncWireTransport> makeSyncUdpTransport(std::string_view remote_host, uint16_t remote_port, std::string_view local_host = "", uint16_t local_port = 0, bool log = false);
+std::unique_ptr<ISyncWireTransport> makeSyncUdpTransport(std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options);
+// Sends to a multicast or broadcast address (group_host:group_port) and receives replies from `members`, given as host and port.
+// Members reply from their unicast addresses to this transport's local endpoint, so local_port should be fixed.
+// An empty local_host binds the wildcard address.  Multicast packets are sent with a TTL of 1, i.e. stay on the local subnet.
+std::unique_ptr<ISyncGroupTransport> makeSyncUdpGroupTransport(std::string_view group_host, uint16_t group_port, std::vector<std::pair<std::string, uint16_t>> const& members, std::string_view local_host = "", uint16_t local_port = 0, UdpTransportOptions const& options = {});
+// Restricts the calling thread to run on `cpu` only (Linux only), e.g. the thread that calls recv() in busy-poll mode.
+void pinCurrentThreadToCpu(unsigned cpu);
+std::shared_ptr<UringContext> makeUringContext(UringContextOptions const& options = {});
+// A connected UDP socket serviced by `ring`, which keeps a multishot receive armed into a ring of provided buffers.
+std::unique_ptr<ISyncWireTransport> makeSyncUringUdpTransport(std::shared_ptr<UringContext> ring, std::string_view remote_host, uint16_t remote_port, std::string_view local_host = "", uint16_t local_port = 0, UdpTransportOptions const& options = {});
+// The server creates the named POSIX shared memory segment (and unlinks it on destruction); the client attaches to it.
+std::unique_ptr<ISyncWireTransport> makeSyncSharedMemoryServerTransport(std::string_view name, size_t max_message_size = 512, bool log = false);
+std::unique_ptr<ISyncWireTransport> makeSyncSharedMemoryClientTransport(std::string_view name, bool log = false);
+// COBS-framed messages over a serial port configured for raw 8N1 at `baud_rate`.
+// A frame_validator such as Serdes::checkCrc lets the receiver drop frames corrupted by line noise.
+std::unique_ptr<ISyncWireTransport> makeSyncSerialTransport(std::string_view device, uint32_t baud_rate, size_t max_message_size = 512, std::function<bool(BufferView)> frame_validator = {}, bool log = false);
+// Takes ownership of an open fd, e.g. one side of an openpty() pair.  A tty is put in raw mode; its baud rate is left alone.
+std::unique_ptr<ISyncWireTransport> makeSyncSerialTransport(int fd, size_t max_message_size = 512, std::function<bool(BufferView)> frame_validator = {}, bool log = false);
+// AF_UNIX SOCK_SEQPACKET sockets; max_message_size may be up to 65535 bytes and must match on both ends.
+std::unique_ptr<ISyncWireTransport> makeSyncUnixSeqpacketTransport(std::string_view path, size_t max_message_size = 16384, bool log = false);
+std::unique_ptr<ISyncWireListener> makeSyncUnixSeqpacketListener(std::string_view path, size_t max_message_size = 16384, bool log = false);
+// Wraps `inner`, delaying, dropping, duplicating, reordering and corrupting the messages sent through it.
+// Received messages pass through untouched, so wrap both ends of a link to impair both directions.
+std::unique_ptr<ISyncWireTransport> makeSyncImpairedTransport(std::unique_ptr<ISyncWireTransport> inner, ImpairmentOptions const& options);
+// Wraps `inner`, counting the messages and bytes sent and received by MessageType, receive timeouts and errors into `stats`.
+std::unique_ptr<ISyncWireTransport> makeSyncInstrumentedTransport(std::unique_ptr<ISyncWireTransport> inner, std::shared_ptr<TransportStats> stats);
+// TCP byte stream with length-prefixed messages; options must agree on max_message_size at both ends.
+std::unique_ptr<ISyncWireTransport> makeSyncTcpTransport(std::string_view remote_host, uint16_t remote_port, TcpTransportOptions const& options = {});
+std::unique_ptr<ISyncWireListener> makeSyncTcpListener(std::string_view local_host, uint16_t local_port, TcpTransportOptions const& options = {});
+
+std::pair<std::unique_ptr<IAsyncWireTransport>, std::unique_ptr<IAsyncWireTransport>> makeAsyncPairedIpcTransport(asio::io_context& io_ctx, size_t max_message_size = 512);
+std::unique_ptr<IAsyncWireTransport> makeAsyncUdpTransport(asio::io_context& io_ctx, std::string_view remote_host, uint16_t remote_port, std::string_view local_host = "", uint16_t local_port = 0, bool log = false);
+std::unique_ptr<IAsyncWireTransport> makeAsyncUdpTransport(asio::io_context& io_ctx, std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options);
+std::unique_ptr<IAsyncWireTransport> makeAsyncUringUdpTransport(asio::io_context& io_ctx, std::shared_ptr<UringContext> ring, std::string_view remote_host, uint16_t remote_port, std::string_view local_host = "", uint16_t local_port = 0, UdpTransportOptions const& options = {});
 
 }
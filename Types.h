@@ -2,6 +2,7 @@
 #include <format>
 #include <span>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 #include <stdint.h>
 
@@ -41,6 +42,23 @@ public:
     uint32_t status;
 };
 
+// A write sent to a group of devices was not acknowledged by all of them.
+// Members are identified by their index in the group transport's member list.
+class BroadcastWriteException : public Exception
+{
+public:
+    BroadcastWriteException(std::vector<size_t> missing_, std::vector<std::pair<size_t, uint32_t>> naks_)
+        : Exception(std::format("Broadcast write not acknowledged by all members. missing:{} nak'd:{}", missing_.size(), naks_.size()))
+        , missing(std::move(missing_))
+        , naks(std::move(naks_))
+    {}
+
+    // Members that did not reply in time.
+    std::vector<size_t> missing;
+    // Members that replied with a NAK (or an unexpected response, reported with status 0), and the status.
+    std::vector<std::pair<size_t, uint32_t>> naks;
+};
+
 class UnexpectedMessageTypeException : public Exception
 {
 public:
@@ -57,6 +75,7 @@ class RapProtocolException : public Exception
 {
 public:
     RapProtocolException() : Exception("Response Transaction ID does not match Command Transaction ID.") {}
+    RapProtocolException(char const* msg) : Exception(msg) {}
 };
 
 class MessageSizeException : public Exception
@@ -0,0 +1,61 @@
+#pragma once
+#include "Transports.h"
+#include <algorithm>
+#include <asio.hpp>
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+// Sizing shared by the UDP transports.
+namespace RAP::Transport::detail {
+
+// The largest UDP payload that fits in one unfragmented packet of `mtu` bytes.
+inline size_t udpMaxMessageSize(size_t mtu, bool is_v6)
+{
+    size_t const ip_header_size = is_v6 ? 40 : 20;
+    size_t const udp_header_size = 8;
+    if (mtu < ip_header_size + udp_header_size + 32)
+        throw Exception("UDP transport mtu is too small");
+    // Both IP versions have a 16-bit length field; IPv4's includes its header, IPv6's does not.
+    auto const ip_payload_size = is_v6 ? std::min<size_t>(mtu - ip_header_size, 65535) : std::min<size_t>(mtu, 65535) - ip_header_size;
+    return ip_payload_size - udp_header_size;
+}
+
+// The MTU to use for a connected socket: with options.discover_path_mtu, the kernel's MTU for the route
+// to the peer (IP_MTU/IPV6_MTU) where available, otherwise options.mtu.
+// It is sampled once, so later path MTU changes are not tracked.
+template <typename NativeHandle>
+size_t udpMtu([[maybe_unused]] NativeHandle fd, [[maybe_unused]] bool is_v6, UdpTransportOptions const& options)
+{
+#if defined(IP_MTU) && defined(IPV6_MTU)
+    if (options.discover_path_mtu) {
+        int path_mtu = 0;
+        socklen_t len = sizeof(path_mtu);
+        if (::getsockopt(fd, is_v6 ? IPPROTO_IPV6 : IPPROTO_IP, is_v6 ? IPV6_MTU : IP_MTU, &path_mtu, &len) == 0 && path_mtu > 0)
+            return path_mtu;
+    }
+#endif
+    return options.mtu;
+}
+
+inline size_t udpMaxMessageSize(asio::ip::udp::socket& socket, UdpTransportOptions const& options)
+{
+    auto const is_v6 = socket.local_endpoint().protocol() == asio::ip::udp::v6();
+    return udpMaxMessageSize(udpMtu(socket.native_handle(), is_v6, options), is_v6);
+}
+
+// For an unconnected socket sending to `peer`: the path MTU is asked of a throwaway socket connected to it.
+inline size_t udpMaxMessageSize(asio::io_context& io_ctx, asio::ip::udp::endpoint const& peer, UdpTransportOptions const& options)
+{
+    if (!options.discover_path_mtu)
+        return udpMaxMessageSize(options.mtu, peer.address().is_v6());
+    asio::ip::udp::socket probe{ io_ctx, peer.protocol() };
+    // Linux refuses to connect to a broadcast address without SO_BROADCAST.
+    if (!peer.address().is_multicast())
+        probe.set_option(asio::socket_base::broadcast(true));
+    probe.connect(peer);
+    return udpMaxMessageSize(probe, options);
+}
+
+}
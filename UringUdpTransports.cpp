@@ -0,0 +1,888 @@
+#include "Transports.h"
+#include "BufferPool.h"
+#include "FdWait.h"
+#include "UdpMtu.h"
+#include <YALF/YALF.h>
+#include <algorithm>
+#include <asio.hpp>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <format>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <linux/io_uring.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace RAP::Transport {
+
+namespace {
+
+int ioUringSetup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+int ioUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+int ioUringRegister(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+struct AddrInfoDeleter {
+    void operator()(addrinfo* ai) const { ::freeaddrinfo(ai); }
+};
+std::unique_ptr<addrinfo, AddrInfoDeleter> resolve(std::string_view host, uint16_t port, int family, bool passive)
+{
+    addrinfo hints{};
+    hints.ai_family = family;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo* result = nullptr;
+    auto const host_str = std::string{ host };
+    auto const rc = ::getaddrinfo(host_str.empty() ? nullptr : host_str.c_str(), std::format("{}", port).c_str(), &hints, &result);
+    if (rc != 0)
+        throw Exception(std::format("getaddrinfo({}:{}): {}", host, port, ::gai_strerror(rc)));
+    return std::unique_ptr<addrinfo, AddrInfoDeleter>{ result };
+}
+
+// Called on the ring's completion thread for each CQE whose user_data points at it.
+class UringCompletion
+{
+public:
+    virtual void complete(io_uring_cqe const& cqe) = 0;
+protected:
+    ~UringCompletion() = default;
+};
+
+}
+
+// Owns the ring and the thread that reaps its completions.
+// Submissions may come from any thread; without SQPOLL each costs one io_uring_enter, which also
+// submits anything else queued.  Completions are reaped in batches, one io_uring_enter per batch.
+class UringContext
+{
+public:
+    explicit UringContext(UringContextOptions const& options)
+        : sq_poll(options.sq_poll)
+    {
+        io_uring_params params{};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = options.entries * 4;
+        if (options.sq_poll) {
+            params.flags |= IORING_SETUP_SQPOLL;
+            params.sq_thread_idle = static_cast<uint32_t>(options.sq_poll_idle.count());
+        }
+        this->fd = ioUringSetup(options.entries, &params);
+        if (this->fd < 0)
+            detail::throwErrno("io_uring_setup");
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+            ::close(this->fd);
+            throw Exception("io_uring transports require IORING_FEAT_SINGLE_MMAP and IORING_FEAT_NODROP");
+        }
+        if (!this->supportsOps({ IORING_OP_NOP, IORING_OP_SEND, IORING_OP_RECV, IORING_OP_ASYNC_CANCEL })) {
+            ::close(this->fd);
+            throw Exception("io_uring transports require IORING_OP_SEND, IORING_OP_RECV and IORING_OP_ASYNC_CANCEL");
+        }
+        this->ring_bytes = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(uint32_t), params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        this->sqes_bytes = params.sq_entries * sizeof(io_uring_sqe);
+        this->ring_mem = ::mmap(nullptr, this->ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING);
+        this->sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, this->sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES));
+        if (this->ring_mem == MAP_FAILED || this->sqes == MAP_FAILED) {
+            auto const err = errno;
+            this->unmap();
+            ::close(this->fd);
+            throw std::system_error(err, std::system_category(), "mmap(io_uring)");
+        }
+        auto* const base = static_cast<uint8_t*>(this->ring_mem);
+        this->sq = {
+            .head = reinterpret_cast<uint32_t*>(base + params.sq_off.head),
+            .tail = reinterpret_cast<uint32_t*>(base + params.sq_off.tail),
+            .mask = *reinterpret_cast<uint32_t*>(base + params.sq_off.ring_mask),
+            .entries = params.sq_entries,
+            .flags = reinterpret_cast<uint32_t*>(base + params.sq_off.flags),
+            .array = reinterpret_cast<uint32_t*>(base + params.sq_off.array),
+        };
+        this->cq = {
+            .head = reinterpret_cast<uint32_t*>(base + params.cq_off.head),
+            .tail = reinterpret_cast<uint32_t*>(base + params.cq_off.tail),
+            .mask = *reinterpret_cast<uint32_t*>(base + params.cq_off.ring_mask),
+            .cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes),
+        };
+        this->reaper = std::jthread([this] { this->run(); });
+    }
+    ~UringContext()
+    {
+        this->stopping = true;
+        // Its completion wakes the reaper, which then sees `stopping`.
+        if (this->running)
+            this->submit([](io_uring_sqe& sqe) { sqe.opcode = IORING_OP_NOP; });
+        this->reaper.join();
+        this->unmap();
+        ::close(this->fd);
+    }
+    static std::string_view getDomain() { return "UringContext"; }
+
+    // Fills in one SQE with `prepare` and submits it.
+    template <typename Prepare>
+    void submit(Prepare&& prepare)
+    {
+        std::lock_guard lg{ this->sq_mtx };
+        auto const tail = *this->sq.tail;
+        while (tail - std::atomic_ref{ *this->sq.head }.load(std::memory_order_acquire) >= this->sq.entries)
+            this->enter(0, 0, this->sq_poll ? IORING_ENTER_SQ_WAIT : 0);
+        auto const index = tail & this->sq.mask;
+        auto& sqe = this->sqes[index];
+        sqe = io_uring_sqe{};
+        prepare(sqe);
+        this->sq.array[index] = index;
+        std::atomic_ref{ *this->sq.tail }.store(tail + 1, std::memory_order_release);
+        if (this->sq_poll) {
+            // Pairs with the kernel thread setting NEED_WAKEUP before it rechecks the tail and sleeps.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (std::atomic_ref{ *this->sq.flags }.load(std::memory_order_relaxed) & IORING_SQ_NEED_WAKEUP)
+                this->enter(0, 0, IORING_ENTER_SQ_WAKEUP);
+        }
+        else {
+            // Also resubmits anything a failed earlier call left behind.
+            this->enter(tail + 1 - std::atomic_ref{ *this->sq.head }.load(std::memory_order_acquire), 0, 0);
+        }
+    }
+    uint16_t allocateBufferGroup()
+    {
+        return this->next_buffer_group.fetch_add(1);
+    }
+    // `ring` must be page aligned, with room for `entries` io_uring_buf.
+    void registerBufferRing(void* ring, unsigned entries, uint16_t buffer_group)
+    {
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uintptr_t>(ring);
+        reg.ring_entries = entries;
+        reg.bgid = buffer_group;
+        if (ioUringRegister(this->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            if (errno == EINVAL)
+                throw Exception("io_uring transports require provided buffer rings (IORING_REGISTER_PBUF_RING)");
+            detail::throwErrno("io_uring_register(PBUF_RING)");
+        }
+    }
+    void unregisterBufferRing(uint16_t buffer_group)
+    {
+        io_uring_buf_reg reg{};
+        reg.bgid = buffer_group;
+        ioUringRegister(this->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    // False once the reaper has given up after an io_uring_enter failure; completions are no longer delivered.
+    bool isRunning() const
+    {
+        return this->running;
+    }
+    // Keeps memory that operations still in flight may use until the ring is closed.
+    void adopt(Buffer buffer)
+    {
+        std::lock_guard lg{ this->orphans_mtx };
+        this->orphans.push_back(std::move(buffer));
+    }
+
+private:
+    // Asks the kernel which opcodes it supports (IORING_REGISTER_PROBE).
+    bool supportsOps(std::initializer_list<uint8_t> opcodes) const
+    {
+        constexpr unsigned max_ops = 256;
+        std::vector<uint8_t> storage(sizeof(io_uring_probe) + max_ops * sizeof(io_uring_probe_op));
+        auto* const probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (ioUringRegister(this->fd, IORING_REGISTER_PROBE, probe, max_ops) < 0)
+            return false;
+        return std::all_of(opcodes.begin(), opcodes.end(), [&](uint8_t op) {
+            return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+        });
+    }
+    void run()
+    {
+        while (true) {
+            auto const head = *this->cq.head;
+            if (head == std::atomic_ref{ *this->cq.tail }.load(std::memory_order_acquire)) {
+                if (this->stopping)
+                    return;
+                try {
+                    this->enter(0, 1, IORING_ENTER_GETEVENTS);
+                }
+                catch (std::exception const& ex) {
+                    LOG_ERROR(this, "io_uring_enter failed: {}", ex.what());
+                    this->running = false;
+                    return;
+                }
+                continue;
+            }
+            // Copied out so the slot can be handed back before the completion runs and possibly submits.
+            auto const cqe = this->cq.cqes[head & this->cq.mask];
+            std::atomic_ref{ *this->cq.head }.store(head + 1, std::memory_order_release);
+            if (cqe.user_data != 0)
+                reinterpret_cast<UringCompletion*>(cqe.user_data)->complete(cqe);
+        }
+    }
+    void enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        while (ioUringEnter(this->fd, to_submit, min_complete, flags) < 0) {
+            if (errno == EAGAIN || errno == EBUSY)
+                std::this_thread::yield();
+            else if (errno != EINTR)
+                detail::throwErrno("io_uring_enter");
+        }
+    }
+    void unmap()
+    {
+        if (this->ring_mem != MAP_FAILED && this->ring_mem != nullptr)
+            ::munmap(this->ring_mem, this->ring_bytes);
+        if (this->sqes != MAP_FAILED && this->sqes != nullptr)
+            ::munmap(this->sqes, this->sqes_bytes);
+    }
+
+private:
+    int fd = -1;
+    bool sq_poll;
+    void* ring_mem = nullptr;
+    size_t ring_bytes = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_bytes = 0;
+    struct {
+        uint32_t* head;
+        uint32_t* tail;
+        uint32_t mask;
+        uint32_t entries;
+        uint32_t* flags;
+        uint32_t* array;
+    } sq{};
+    struct {
+        uint32_t* head;
+        uint32_t* tail;
+        uint32_t mask;
+        io_uring_cqe* cqes;
+    } cq{};
+    std::mutex sq_mtx;
+    std::atomic<uint16_t> next_buffer_group = 0;
+    std::atomic<bool> stopping = false;
+    std::atomic<bool> running = true;
+    std::mutex orphans_mtx;
+    std::vector<Buffer> orphans;
+    std::jthread reaper;
+};
+
+std::shared_ptr<UringContext> makeUringContext(UringContextOptions const& options)
+{
+    return std::make_shared<UringContext>(options);
+}
+
+// A connected UDP socket driven by a UringContext, shared by the sync and async transports.
+// A multishot receive stays armed on the socket and the kernel picks a buffer for each datagram from a
+// ring of provided buffers, so receiving takes no syscalls of our own.  Each datagram is handed to
+// `on_datagram` on the ring's thread and its buffer is returned to the kernel straight away.
+// Sends are copied into one of a fixed set of slots, which stays busy until the send completes.
+class UringUdpSocket
+{
+private:
+    static constexpr unsigned RxBufferCount = 64;
+    static constexpr size_t SendSlotCount = 16;
+    static constexpr size_t MaxQueuedSends = 256;
+public:
+    using DatagramHandler = std::function<void(BufferView)>;
+    using ErrorHandler = std::function<void(std::error_code)>;
+    using SendHandler = std::function<void(std::error_code)>;
+
+    UringUdpSocket(std::shared_ptr<UringContext> ring_, std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options, DatagramHandler on_datagram_, ErrorHandler on_error_)
+        : ring(std::move(ring_))
+        , fd(-1)
+        , on_datagram(std::move(on_datagram_))
+        , on_error(std::move(on_error_))
+        , recv_op(*this)
+    {
+        auto const remote = resolve(remote_host, remote_port, AF_UNSPEC, false);
+        this->fd = ::socket(remote->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (this->fd < 0)
+            detail::throwErrno("socket");
+        try {
+            if (!local_host.empty() || local_port != 0) {
+                auto const local = resolve(local_host, local_port, remote->ai_family, true);
+                if (::bind(this->fd, local->ai_addr, local->ai_addrlen) != 0)
+                    detail::throwErrno("bind");
+            }
+            if (::connect(this->fd, remote->ai_addr, remote->ai_addrlen) != 0)
+                detail::throwErrno("connect");
+            auto const is_v6 = remote->ai_family == AF_INET6;
+            this->max_message_size = detail::udpMaxMessageSize(detail::udpMtu(this->fd, is_v6, options), is_v6);
+
+            this->buf_ring_bytes = RxBufferCount * sizeof(io_uring_buf);
+            this->buf_ring = ::mmap(nullptr, this->buf_ring_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (this->buf_ring == MAP_FAILED)
+                detail::throwErrno("mmap");
+            this->rx_buffers.resize(RxBufferCount * this->max_message_size);
+            this->buffer_group = this->ring->allocateBufferGroup();
+            this->ring->registerBufferRing(this->buf_ring, RxBufferCount, this->buffer_group);
+        }
+        catch (...) {
+            if (this->buf_ring != MAP_FAILED && this->buf_ring != nullptr)
+                ::munmap(this->buf_ring, this->buf_ring_bytes);
+            ::close(this->fd);
+            throw;
+        }
+        for (uint16_t bid = 0; bid < RxBufferCount; bid++)
+            this->recycle(bid);
+        this->send_slots.reserve(SendSlotCount);
+        for (size_t i = 0; i < SendSlotCount; i++) {
+            this->send_slots.emplace_back(*this);
+            this->send_slots.back().buffer.reserve(this->max_message_size);
+        }
+        for (auto& slot : this->send_slots)
+            this->free_slots.push_back(&slot);
+        std::lock_guard lg{ this->mtx };
+        this->armRecv();
+    }
+    ~UringUdpSocket()
+    {
+        {
+            std::lock_guard lg{ this->mtx };
+            this->closing = true;
+        }
+        try {
+            this->ring->submit([this](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_ASYNC_CANCEL;
+                sqe.addr = reinterpret_cast<uintptr_t>(static_cast<UringCompletion*>(&this->recv_op));
+            });
+        }
+        catch (std::exception const& ex) {
+            LOG_ERROR(this, "Could not cancel receive: {}", ex.what());
+        }
+        // The kernel may still write into rx_buffers, and completions still reference this object, until these finish.
+        // Nothing wakes us if the reaper dies meanwhile, hence the polling.
+        std::unique_lock lk{ this->mtx };
+        auto const done = [&] { return !this->recv_armed && this->free_slots.size() == this->send_slots.size(); };
+        while (!this->cv.wait_for(lk, std::chrono::milliseconds(100), done) && this->ring->isRunning()) {}
+        auto const orphaned = !done();
+        lk.unlock();
+        this->ring->unregisterBufferRing(this->buffer_group);
+        if (orphaned) {
+            // The reaper is gone, so the outstanding operations never complete; the kernel may still use their buffers.
+            this->ring->adopt(std::move(this->rx_buffers));
+            for (auto& slot : this->send_slots) {
+                this->ring->adopt(std::move(slot.buffer));
+                if (auto const on_sent = std::exchange(slot.on_sent, nullptr))
+                    on_sent(std::make_error_code(std::errc::operation_canceled));
+            }
+            for (auto& q : std::exchange(this->queued_sends, {}))
+                q.on_sent(std::make_error_code(std::errc::operation_canceled));
+        }
+        ::munmap(this->buf_ring, this->buf_ring_bytes);
+        ::close(this->fd);
+    }
+    static std::string_view getDomain() { return "UringUdpSocket"; }
+
+    // Waits up to `timeout` for a free send slot.  `on_sent` is called on the ring's thread when the send completes.
+    void send(BufferView buffer, std::chrono::microseconds timeout, SendHandler on_sent)
+    {
+        this->checkSend(buffer);
+        SendSlot* slot;
+        {
+            std::unique_lock lk{ this->mtx };
+            if (!this->cv.wait_for(lk, timeout, [&] { return !this->free_slots.empty(); }))
+                throw TransportTimeoutException();
+            slot = this->free_slots.back();
+            this->free_slots.pop_back();
+        }
+        slot->buffer.assign(buffer.begin(), buffer.end());
+        slot->on_sent = std::move(on_sent);
+        this->submitSend(slot);
+    }
+    // Like send(), but never blocks: if every slot is in flight the datagram is queued and sent from
+    // the ring's thread as soon as one frees up.
+    void post(BufferView buffer, SendHandler on_sent)
+    {
+        this->checkSend(buffer);
+        SendSlot* slot;
+        {
+            std::lock_guard lg{ this->mtx };
+            if (this->free_slots.empty()) {
+                if (this->queued_sends.size() >= MaxQueuedSends)
+                    throw TransportTimeoutException();
+                this->queued_sends.push_back(QueuedSend{ .buffer = Buffer{ buffer.begin(), buffer.end() }, .on_sent = std::move(on_sent) });
+                return;
+            }
+            slot = this->free_slots.back();
+            this->free_slots.pop_back();
+        }
+        slot->buffer.assign(buffer.begin(), buffer.end());
+        slot->on_sent = std::move(on_sent);
+        this->submitSend(slot);
+    }
+    size_t getMaxMessageSize() const { return this->max_message_size; }
+
+private:
+    struct RecvOp final : UringCompletion {
+        explicit RecvOp(UringUdpSocket& owner_) : owner(owner_) {}
+        virtual void complete(io_uring_cqe const& cqe) override { this->owner.onRecv(cqe); }
+        UringUdpSocket& owner;
+    };
+    struct SendSlot final : UringCompletion {
+        explicit SendSlot(UringUdpSocket& owner_) : owner(&owner_) {}
+        virtual void complete(io_uring_cqe const& cqe) override { this->owner->onSent(*this, cqe); }
+        UringUdpSocket* owner;
+        Buffer buffer;
+        SendHandler on_sent;
+    };
+    struct QueuedSend {
+        Buffer buffer;
+        SendHandler on_sent;
+    };
+
+    void checkSend(BufferView buffer) const
+    {
+        if (buffer.size() > this->max_message_size)
+            throw MessageSizeException("Message exceeds the transport's max_message_size");
+        if (!this->ring->isRunning())
+            throw TransportClosedException();
+    }
+    // Submits the send already copied into `slot`, handing the slot back if that fails.
+    void submitSend(SendSlot* slot)
+    {
+        try {
+            this->ring->submit([&](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_SEND;
+                sqe.fd = this->fd;
+                sqe.addr = reinterpret_cast<uintptr_t>(slot->buffer.data());
+                sqe.len = static_cast<uint32_t>(slot->buffer.size());
+                sqe.user_data = reinterpret_cast<uintptr_t>(static_cast<UringCompletion*>(slot));
+            });
+        }
+        catch (...) {
+            slot->on_sent = nullptr;
+            std::lock_guard lg{ this->mtx };
+            this->free_slots.push_back(slot);
+            this->cv.notify_all();
+            throw;
+        }
+    }
+
+    // Must be called with `mtx` held.
+    void armRecv()
+    {
+        this->recv_armed = true;
+        this->ring->submit([this](io_uring_sqe& sqe) {
+            sqe.opcode = IORING_OP_RECV;
+            sqe.fd = this->fd;
+            sqe.ioprio = IORING_RECV_MULTISHOT;
+            sqe.flags = IOSQE_BUFFER_SELECT;
+            sqe.buf_group = this->buffer_group;
+            sqe.user_data = reinterpret_cast<uintptr_t>(static_cast<UringCompletion*>(&this->recv_op));
+        });
+    }
+    // Hands buffer `bid` (back) to the kernel.  Only called before arming and on the ring's thread.
+    void recycle(uint16_t bid)
+    {
+        auto* const bufs = static_cast<io_uring_buf*>(this->buf_ring);
+        auto& buf = bufs[this->buf_ring_tail & (RxBufferCount - 1)];
+        buf.addr = reinterpret_cast<uintptr_t>(this->rx_buffers.data() + bid * this->max_message_size);
+        buf.len = static_cast<uint32_t>(this->max_message_size);
+        buf.bid = bid;
+        this->buf_ring_tail++;
+        std::atomic_ref{ static_cast<io_uring_buf_ring*>(this->buf_ring)->tail }.store(this->buf_ring_tail, std::memory_order_release);
+    }
+    void onRecv(io_uring_cqe const& cqe)
+    {
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            auto const bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe.res >= 0)
+                this->on_datagram(BufferView{ this->rx_buffers }.subspan(bid * this->max_message_size, cqe.res));
+            this->recycle(bid);
+        }
+        else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+            this->on_error(std::error_code(-cqe.res, std::system_category()));
+        }
+        if (cqe.flags & IORING_CQE_F_MORE)
+            return;
+        // The multishot receive ended.  It is re-armed after running out of buffers or a transient error;
+        // any other error (e.g. -EINVAL from a kernel without multishot receives) would recur straight away,
+        // so receiving stops once it has been reported.
+        auto const transient = cqe.res >= 0 || cqe.res == -ENOBUFS || cqe.res == -EINTR || cqe.res == -EAGAIN || cqe.res == -ENOMEM;
+        std::lock_guard lg{ this->mtx };
+        if (this->closing || !transient) {
+            this->recv_armed = false;
+            this->cv.notify_all();
+            return;
+        }
+        try {
+            this->armRecv();
+        }
+        catch (std::exception const& ex) {
+            this->recv_armed = false;
+            this->cv.notify_all();
+            LOG_ERROR(this, "Could not re-arm receive: {}", ex.what());
+        }
+    }
+    void onSent(SendSlot& slot, io_uring_cqe const& cqe)
+    {
+        // Called before the slot is freed, so the destructor waits for it.
+        if (auto const on_sent = std::exchange(slot.on_sent, nullptr))
+            on_sent(cqe.res < 0 ? std::error_code(-cqe.res, std::system_category()) : std::error_code{});
+        std::unique_lock lk{ this->mtx };
+        if (this->queued_sends.empty() || this->closing) {
+            auto queued_sends_ = std::exchange(this->queued_sends, {});
+            this->free_slots.push_back(&slot);
+            this->cv.notify_all();
+            lk.unlock();
+            for (auto& q : queued_sends_)
+                q.on_sent(std::make_error_code(std::errc::operation_canceled));
+            return;
+        }
+        // Reuse the slot for the oldest queued send.
+        auto queued = std::move(this->queued_sends.front());
+        this->queued_sends.pop_front();
+        lk.unlock();
+        slot.buffer = std::move(queued.buffer);
+        slot.on_sent = queued.on_sent;
+        try {
+            this->submitSend(&slot);
+        }
+        catch (std::exception const& ex) {
+            LOG_ERROR(this, "Could not submit a queued send: {}", ex.what());
+            queued.on_sent(std::make_error_code(std::errc::io_error));
+        }
+    }
+
+private:
+    std::shared_ptr<UringContext> ring;
+    int fd;
+    size_t max_message_size = 0;
+    DatagramHandler on_datagram;
+    ErrorHandler on_error;
+
+    uint16_t buffer_group = 0;
+    void* buf_ring = nullptr;
+    size_t buf_ring_bytes = 0;
+    uint16_t buf_ring_tail = 0;
+    Buffer rx_buffers;
+    RecvOp recv_op;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool recv_armed = false;
+    bool closing = false;
+    std::vector<SendSlot> send_slots;
+    std::vector<SendSlot*> free_slots;
+    std::deque<QueuedSend> queued_sends;
+};
+
+// Completed datagrams are queued for recv(), as in UdpTransport.
+class UringUdpTransport : public ISyncWireTransport
+{
+private:
+    static constexpr size_t MaxQueuedDatagrams = 256;
+public:
+    UringUdpTransport(std::shared_ptr<UringContext> ring, std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options)
+        : timeout(std::chrono::seconds(1))
+        , log(options.log)
+    {
+        this->socket = std::make_unique<UringUdpSocket>(std::move(ring), remote_host, remote_port, local_host, local_port, options,
+            [this](BufferView datagram) { this->onDatagram(datagram); },
+            [this](std::error_code ec) { this->onError(ec); });
+        this->pool = std::make_unique<BufferPool>(this->socket->getMaxMessageSize(), 8);
+    }
+    ~UringUdpTransport()
+    {
+        // Stops the completions before the queue they deliver to goes away.
+        this->socket.reset();
+    }
+    static std::string_view getDomain() { return "UringUdpTransport"; }
+
+    virtual void send(BufferView buffer) override
+    {
+        if (log) {
+            std::string data_str;
+            for (auto const d : buffer)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "send >>> [ {}]", data_str);
+        }
+        // Send errors (e.g. ECONNREFUSED) are reported by the next recv(), like receive errors.
+        this->socket->send(buffer, this->timeout, [this](std::error_code ec) {
+            if (ec)
+                this->onError(ec);
+        });
+    }
+    virtual Buffer recv() override
+    {
+        auto const pooled = this->pop(std::stop_token{});
+        return *pooled;
+    }
+    virtual Buffer recv(std::stop_token stoken) override
+    {
+        auto const pooled = this->pop(stoken);
+        return *pooled;
+    }
+    virtual size_t recv(std::span<uint8_t> buffer) override
+    {
+        return this->recv(buffer, std::stop_token{});
+    }
+    virtual size_t recv(std::span<uint8_t> buffer, std::stop_token stoken) override
+    {
+        auto const pooled = this->pop(stoken);
+        if (pooled->size() > buffer.size())
+            throw MessageSizeException("Received message does not fit in the supplied buffer");
+        std::copy(pooled->begin(), pooled->end(), buffer.begin());
+        return pooled->size();
+    }
+    virtual uint16_t getMaxMessageSize() const override
+    {
+        return static_cast<uint16_t>(this->socket->getMaxMessageSize());
+    }
+    virtual void setTimeout(std::chrono::microseconds new_timeout) override
+    {
+        this->timeout = new_timeout;
+    }
+    virtual std::optional<std::chrono::microseconds> getTimeout() const override
+    {
+        return this->timeout;
+    }
+
+private:
+    // Runs on the ring's thread.
+    void onDatagram(BufferView datagram)
+    {
+        {
+            std::lock_guard lg{ this->mtx };
+            if (this->queue.size() >= MaxQueuedDatagrams)
+                return;
+            auto pooled = this->pool->lease();
+            pooled->assign(datagram.begin(), datagram.end());
+            this->queue.push(std::move(pooled));
+        }
+        this->cv.notify_one();
+    }
+    void onError(std::error_code ec)
+    {
+        {
+            std::lock_guard lg{ this->mtx };
+            this->error = ec;
+        }
+        this->cv.notify_one();
+    }
+    // Returns an empty PooledBuffer if stopped.
+    PooledBuffer pop(std::stop_token stoken)
+    {
+        std::unique_lock lk{ this->mtx };
+        this->cv.wait_for(lk, stoken, this->timeout, [&] {
+            return !this->queue.empty() || this->error;
+        });
+        if (stoken.stop_requested())
+            return this->pool->lease();
+        if (this->error)
+            throw std::system_error(std::exchange(this->error, {}));
+        if (this->queue.empty())
+            throw TransportTimeoutException();
+        auto pooled = this->queue.pop();
+        if (log) {
+            std::string data_str;
+            for (auto const d : *pooled)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "recv <<< [ {}]", data_str);
+        }
+        return pooled;
+    }
+
+private:
+    std::chrono::microseconds timeout;
+    bool log;
+    std::mutex mtx;
+    std::condition_variable_any cv;
+    // Declared before `queue`, whose buffers are returned to it on destruction.
+    std::unique_ptr<BufferPool> pool;
+    PooledBufferQueue queue;
+    std::error_code error;
+    std::unique_ptr<UringUdpSocket> socket;
+};
+
+// Datagrams arriving while no asyncRecv is pending are queued (up to a limit) on the io_context side,
+// since the multishot receive takes them off the socket regardless.
+class AsyncUringUdpTransport : public IAsyncWireTransport
+{
+private:
+    static constexpr size_t MaxQueuedDatagrams = 256;
+    struct PendingRecv {
+        RecvHandler handler;
+        std::chrono::steady_clock::time_point deadline;
+    };
+    // Everything the io_context may still touch after the transport is destroyed lives here.
+    // All members except `timeout` are only accessed on the io_context thread.
+    struct State : std::enable_shared_from_this<State> {
+        State(asio::io_context& io_ctx_, bool log_)
+            : io_ctx(io_ctx_)
+            , timer(io_ctx_)
+            , timeout(std::chrono::seconds(1))
+            , log(log_)
+        {}
+        static std::string_view getDomain() { return "AsyncUringUdpTransport"; }
+
+        void startRecv(RecvHandler handler)
+        {
+            if (!this->queued.empty()) {
+                auto buffer = std::move(this->queued.front());
+                this->queued.pop_front();
+                handler(nullptr, std::move(buffer));
+                return;
+            }
+            auto const deadline = std::chrono::steady_clock::now() + this->timeout.load();
+            this->pending.push_back(PendingRecv{ .handler = std::move(handler), .deadline = deadline });
+            if (this->pending.size() == 1)
+                this->armTimer();
+        }
+        void deliver(std::exception_ptr error, Buffer buffer)
+        {
+            if (this->log && !error) {
+                std::string data_str;
+                for (auto const d : buffer)
+                    std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+                LOG_NOISE(this, "recv <<< [ {}]", data_str);
+            }
+            if (this->pending.empty()) {
+                if (!error && this->queued.size() < MaxQueuedDatagrams)
+                    this->queued.push_back(std::move(buffer));
+                return;
+            }
+            auto handler = std::move(this->pending.front().handler);
+            this->pending.pop_front();
+            this->armTimer();
+            handler(error, std::move(buffer));
+        }
+        void armTimer()
+        {
+            if (this->pending.empty()) {
+                this->timer.cancel();
+                return;
+            }
+            this->timer.expires_at(this->pending.front().deadline);
+            this->timer.async_wait([self = this->shared_from_this()](std::error_code const& ec) {
+                if (ec == asio::error::operation_aborted)
+                    return;
+                self->expire();
+            });
+        }
+        void expire()
+        {
+            auto const now = std::chrono::steady_clock::now();
+            while (!this->pending.empty() && this->pending.front().deadline <= now) {
+                auto handler = std::move(this->pending.front().handler);
+                this->pending.pop_front();
+                handler(std::make_exception_ptr(TransportTimeoutException()), Buffer{});
+            }
+            this->armTimer();
+        }
+        void cancelAll()
+        {
+            this->timer.cancel();
+            auto pending_ = std::exchange(this->pending, {});
+            for (auto& p : pending_)
+                p.handler(std::make_exception_ptr(TransportCancelledException()), Buffer{});
+        }
+
+        asio::io_context& io_ctx;
+        asio::steady_timer timer;
+        std::deque<PendingRecv> pending;
+        std::deque<Buffer> queued;
+        std::atomic<std::chrono::microseconds> timeout;
+        bool log;
+    };
+
+public:
+    AsyncUringUdpTransport(asio::io_context& io_ctx, std::shared_ptr<UringContext> ring, std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options)
+        : state(std::make_shared<State>(io_ctx, options.log))
+    {
+        this->socket = std::make_unique<UringUdpSocket>(std::move(ring), remote_host, remote_port, local_host, local_port, options,
+            [state = this->state](BufferView datagram) {
+                asio::post(state->io_ctx, [state, buffer = Buffer{ datagram.begin(), datagram.end() }]() mutable {
+                    state->deliver(nullptr, std::move(buffer));
+                });
+            },
+            [state = this->state](std::error_code ec) {
+                asio::post(state->io_ctx, [state, ec] {
+                    state->deliver(std::make_exception_ptr(std::system_error(ec)), Buffer{});
+                });
+            });
+    }
+    ~AsyncUringUdpTransport()
+    {
+        this->socket.reset();
+        asio::post(this->state->io_ctx, [state = this->state] {
+            state->cancelAll();
+        });
+    }
+    static std::string_view getDomain() { return "AsyncUringUdpTransport"; }
+    using IAsyncWireTransport::asyncSend;
+    using IAsyncWireTransport::asyncRecv;
+
+    // Never blocks; sends are queued while all of the socket's send slots are in flight.
+    virtual void asyncSend(BufferView buffer, SendHandler handler) override
+    {
+        if (this->state->log) {
+            std::string data_str;
+            for (auto const d : buffer)
+                std::format_to(std::back_inserter(data_str), "{:02x} ", d);
+            LOG_NOISE(this, "send >>> [ {}]", data_str);
+        }
+        try {
+            // The send completes on the ring's thread, so keep io_context::run() from returning in the meantime.
+            auto work = asio::make_work_guard(this->state->io_ctx);
+            this->socket->post(buffer, [state = this->state, handler, work](std::error_code ec) {
+                asio::post(state->io_ctx, [handler, ec] {
+                    handler(ec ? std::make_exception_ptr(std::system_error(ec)) : nullptr);
+                });
+            });
+        }
+        catch (...) {
+            asio::post(this->state->io_ctx, [handler = std::move(handler), error = std::current_exception()] {
+                handler(error);
+            });
+        }
+    }
+    virtual void asyncRecv(RecvHandler handler) override
+    {
+        asio::post(this->state->io_ctx, [state = this->state, handler = std::move(handler)]() mutable {
+            state->startRecv(std::move(handler));
+        });
+    }
+    virtual void cancel() override
+    {
+        asio::post(this->state->io_ctx, [state = this->state] {
+            state->cancelAll();
+        });
+    }
+    virtual uint16_t getMaxMessageSize() const override
+    {
+        return static_cast<uint16_t>(this->socket->getMaxMessageSize());
+    }
+    virtual void setTimeout(std::chrono::microseconds new_timeout) override
+    {
+        this->state->timeout = new_timeout;
+    }
+
+private:
+    std::shared_ptr<State> state;
+    std::unique_ptr<UringUdpSocket> socket;
+};
+
+std::unique_ptr<ISyncWireTransport> makeSyncUringUdpTransport(std::shared_ptr<UringContext> ring, std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options)
+{
+    return std::make_unique<UringUdpTransport>(std::move(ring), remote_host, remote_port, local_host, local_port, options);
+}
+std::unique_ptr<IAsyncWireTransport> makeAsyncUringUdpTransport(asio::io_context& io_ctx, std::shared_ptr<UringContext> ring, std::string_view remote_host, uint16_t remote_port, std::string_view local_host, uint16_t local_port, UdpTransportOptions const& options)
+{
+    return std::make_unique<AsyncUringUdpTransport>(io_ctx, std::move(ring), remote_host, remote_port, local_host, local_port, options);
+}
+
+}
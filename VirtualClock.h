@@ -0,0 +1,36 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+
+namespace RAP::Transport {
+
+// Simulated time for impaired transports (ImpairmentOptions::clock).  It starts at zero and moves forward only
+// when a transport jumps it to the delivery time of a message it is holding, or by the timeout of a receive
+// that timed out.  Latency, jitter and bandwidth limits then cost no real time.  Timeouts still do: a receive
+// whose message was lost waits out the transport's timeout in real time before the clock moves on by as much,
+// so keep timeouts short on lossy links.  Anything that times the transport itself, such as RapRegisterTarget's
+// round-trip estimation, reads the real clock and sees none of the simulated delay.
+class VirtualClock
+{
+public:
+    std::chrono::nanoseconds now() const
+    {
+        return std::chrono::nanoseconds(this->ns.load());
+    }
+    // Moves the clock forward to `t`; it never moves backwards.
+    void advanceTo(std::chrono::nanoseconds t)
+    {
+        auto current = this->ns.load();
+        while (current < t.count() && !this->ns.compare_exchange_weak(current, t.count())) {
+        }
+    }
+    void advance(std::chrono::nanoseconds d)
+    {
+        this->ns.fetch_add(d.count());
+    }
+
+private:
+    std::atomic<int64_t> ns{ 0 };
+};
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdio>
+
+// Minimal checks for the standalone test programs in this directory.
+// Each failed check is reported and counted; main() returns RAP::Test::result().
+namespace RAP::Test {
+
+inline int failures = 0;
+
+inline void check(bool ok, char const* what, char const* file, int line)
+{
+    if (ok)
+        return;
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    failures++;
+}
+inline int result()
+{
+    if (failures != 0)
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+    return failures != 0 ? 1 : 0;
+}
+
+}
+
+#define CHECK(cond) ::RAP::Test::check(static_cast<bool>(cond), #cond, __FILE__, __LINE__)
+#define CHECK_THROWS(expr, ExceptionType)                                                   \
+    do {                                                                                    \
+        bool thrown_ = false;                                                               \
+        try {                                                                               \
+            expr;                                                                           \
+        }                                                                                   \
+        catch (ExceptionType const&) {                                                      \
+            thrown_ = true;                                                                 \
+        }                                                                                   \
+        ::RAP::Test::check(thrown_, #expr " throws " #ExceptionType, __FILE__, __LINE__);   \
+    } while (false)
@@ -0,0 +1,96 @@
+#include "Cobs.h"
+#include "Check.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+std::vector<RAP::Buffer> messages()
+{
+    std::vector<RAP::Buffer> result{
+        {},
+        { 0x00 },
+        { 0x00, 0x00, 0x00 },
+        { 0x11, 0x22, 0x00, 0x33 },
+        { 0x11, 0x00 },
+        { 0x00, 0x11 },
+    };
+    // Runs of non-zero bytes around the 254-byte block length, with and without a trailing zero.
+    for (size_t size : { 253, 254, 255, 508, 509, 1000 }) {
+        RAP::Buffer m(size);
+        for (size_t i = 0; i < size; i++)
+            m[i] = static_cast<uint8_t>(i % 255 + 1);
+        result.push_back(m);
+        m.push_back(0x00);
+        result.push_back(m);
+    }
+    RAP::Buffer every_byte(512);
+    for (size_t i = 0; i < every_byte.size(); i++)
+        every_byte[i] = static_cast<uint8_t>(i);
+    result.push_back(every_byte);
+    return result;
+}
+
+// The frame without its delimiters.
+RAP::BufferView body(RAP::Buffer const& frame)
+{
+    return RAP::BufferView{ frame }.subspan(1, frame.size() - 2);
+}
+
+}
+
+int main()
+{
+    // Round trip, with the frame's only zeros being its delimiters and its size within the bound.
+    for (auto const& m : messages()) {
+        RAP::Buffer frame;
+        RAP::Cobs::encode(m, frame);
+        CHECK(frame.size() <= RAP::Cobs::maxFrameSize(m.size()));
+        CHECK(frame.front() == 0x00 && frame.back() == 0x00);
+        CHECK(std::count(frame.begin() + 1, frame.end() - 1, 0x00) == 0);
+        RAP::Buffer decoded;
+        CHECK(RAP::Cobs::decode(body(frame), decoded));
+        CHECK(decoded == m);
+    }
+    RAP::Buffer frame;
+    RAP::Cobs::encode({}, frame);
+    CHECK((frame == RAP::Buffer{ 0x00, 0x01, 0x00 }));
+    frame.clear();
+    RAP::Cobs::encode(RAP::Buffer{ 0x11, 0x22, 0x00, 0x33 }, frame);
+    CHECK((frame == RAP::Buffer{ 0x00, 0x03, 0x11, 0x22, 0x02, 0x33, 0x00 }));
+
+    // Malformed frames: a zero code, or a code running past the end.
+    RAP::Buffer decoded;
+    CHECK(!RAP::Cobs::decode(RAP::Buffer{ 0x02, 0x11, 0x00 }, decoded));
+    CHECK(!RAP::Cobs::decode(RAP::Buffer{ 0x05, 0x11, 0x22 }, decoded));
+
+    // The deframer takes the stream in arbitrary pieces, drops noise and oversize frames, and resynchronizes.
+    constexpr size_t MaxMessageSize = 600;
+    auto const all = messages();
+    RAP::Buffer stream{ 0x12, 0x34 };
+    std::vector<RAP::Buffer> expected;
+    for (auto const& m : all) {
+        RAP::Cobs::encode(m, stream);
+        if (m.size() <= MaxMessageSize)
+            expected.push_back(m);
+    }
+    for (size_t chunk : { 1, 7, 255, 100000 }) {
+        RAP::Cobs::Deframer deframer(MaxMessageSize);
+        std::vector<RAP::Buffer> received;
+        for (size_t offset = 0; offset < stream.size(); offset += chunk) {
+            auto const piece = RAP::BufferView{ stream }.subspan(offset, std::min(chunk, stream.size() - offset));
+            deframer.feed(piece, [&](RAP::BufferView m) { received.emplace_back(m.begin(), m.end()); });
+        }
+        CHECK(received == expected);
+        // The noise, and the messages that are too long.
+        CHECK(deframer.getDroppedFrames() == 1 + all.size() - expected.size());
+    }
+
+    // Frames the validator rejects are dropped too.
+    RAP::Cobs::Deframer deframer(MaxMessageSize, [](RAP::BufferView m) { return !m.empty() && m[0] == 0x11; });
+    size_t accepted = 0;
+    deframer.feed(stream, [&](RAP::BufferView m) { accepted++; CHECK(m[0] == 0x11); });
+    CHECK(accepted == 2);
+    return RAP::Test::result();
+}
@@ -0,0 +1,99 @@
+#include "MmapTarget.h"
+#include "Check.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using Cfg = RAP::ExampleRapCfg;
+using DataType = Cfg::DataType;
+
+namespace {
+
+constexpr size_t MapSize = 4096;
+constexpr Cfg::AddressType Base = 0x1000;
+constexpr Cfg::AddressType End = Base + MapSize;
+
+// Reads the register at `addr` straight from the file, bypassing the target.
+DataType peek(int fd, Cfg::AddressType addr)
+{
+    DataType value = 0;
+    CHECK(::pread(fd, &value, sizeof(value), addr - Base) == sizeof(value));
+    return value;
+}
+
+}
+
+int main()
+{
+    int const fd = ::memfd_create("MmapTargetTest", MFD_CLOEXEC);
+    CHECK(fd >= 0);
+    CHECK(::ftruncate(fd, MapSize) == 0);
+    {
+        RAP::RTF::MmapRegisterTarget<Cfg> target("mmap", fd, MapSize, 0, Base);
+
+        // Aligned single accesses land at addr - base_addr.
+        target.write(Base, 0x11111111);
+        target.write(Base + 4, 0x22222222);
+        target.write(End - 4, 0x33333333);
+        CHECK(peek(fd, Base) == 0x11111111);
+        CHECK(peek(fd, Base + 4) == 0x22222222);
+        CHECK(peek(fd, End - 4) == 0x33333333);
+        CHECK(target.read(Base + 4) == 0x22222222);
+        target.readModifyWrite(Base + 4, 0x0000ABCD, 0x0000FFFF);
+        CHECK(target.read(Base + 4) == 0x2222ABCD);
+
+        // Unaligned and out-of-range addresses are rejected.
+        CHECK_THROWS((void)target.read(Base + 1), RAP::Exception);
+        CHECK_THROWS(target.write(Base + 6, 0), RAP::Exception);
+        CHECK_THROWS((void)target.read(Base - 4), RAP::Exception);
+        CHECK_THROWS((void)target.read(End), RAP::Exception);
+        CHECK_THROWS(target.write(End, 0), RAP::Exception);
+
+        // Contiguous sequential access.
+        std::vector<DataType> const data{ 1, 2, 3, 4 };
+        std::vector<DataType> out(data.size());
+        target.seqWrite(Base + 0x100, data);
+        target.seqRead(Base + 0x100, out);
+        CHECK(out == data);
+        CHECK(peek(fd, Base + 0x10C) == 4);
+
+        // Strided access touches every other register and leaves the ones in between alone.
+        target.seqWrite(Base + 0x200, std::vector<DataType>(8, 0xFFFFFFFF));
+        target.seqWrite(Base + 0x200, data, 2 * sizeof(DataType));
+        std::vector<DataType> all(8);
+        target.seqRead(Base + 0x200, all);
+        CHECK((all == std::vector<DataType>{ 1, 0xFFFFFFFF, 2, 0xFFFFFFFF, 3, 0xFFFFFFFF, 4, 0xFFFFFFFF }));
+        target.seqRead(Base + 0x200, out, 2 * sizeof(DataType));
+        CHECK(out == data);
+
+        // A transfer running off the end of the mapping is rejected before anything is written.
+        target.write(End - 8, 0);
+        CHECK_THROWS(target.seqWrite(End - 8, data), RAP::Exception);
+        CHECK(peek(fd, End - 8) == 0);
+        CHECK_THROWS(target.seqRead(End - 16, out, 2 * sizeof(DataType)), RAP::Exception);
+        // A sub-register increment ends up at unaligned addresses.
+        CHECK_THROWS(target.seqWrite(Base + 0x300, data, 2), RAP::Exception);
+
+        // FIFO accesses hit the same register every time.
+        target.fifoWrite(Base + 0x400, data);
+        CHECK(peek(fd, Base + 0x400) == 4);
+        CHECK(peek(fd, Base + 0x404) == 0);
+        target.fifoRead(Base + 0x400, out);
+        CHECK((out == std::vector<DataType>(4, 4)));
+
+        // Compressed accesses.
+        std::array<std::pair<Cfg::AddressType, DataType>, 3> const addr_data{ { { Base + 0x508, 8 }, { Base + 0x500, 5 }, { End - 4, 9 } } };
+        target.compWrite(addr_data);
+        std::array<Cfg::AddressType, 3> const addresses{ End - 4, Base + 0x500, Base + 0x508 };
+        std::array<DataType, 3> comp_out{};
+        target.compRead(addresses, comp_out);
+        CHECK((comp_out == std::array<DataType, 3>{ 9, 5, 8 }));
+        CHECK_THROWS(target.compRead(std::array<Cfg::AddressType, 1>{ Base + 2 }, std::span{ comp_out }.first(1)), RAP::Exception);
+    }
+    // The descriptor was not ours to close.
+    CHECK(::fcntl(fd, F_GETFD) >= 0);
+    ::close(fd);
+    return RAP::Test::result();
+}
@@ -0,0 +1,183 @@
+#include "RouterTarget.h"
+#include "SparseMemoryTarget.h"
+#include "Check.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using Cfg = RAP::ExampleRapCfg;
+using AddressType = Cfg::AddressType;
+using DataType = Cfg::DataType;
+
+namespace {
+
+// Remembers the sub-batches it receives.
+class RecordingTarget : public RAP::RTF::SparseMemoryRegisterTarget<Cfg>
+{
+public:
+    struct Call {
+        AddressType addr;
+        size_t count;
+        size_t increment;
+    };
+    using SparseMemoryRegisterTarget::SparseMemoryRegisterTarget;
+
+    virtual void seqWrite(AddressType start_addr, std::span<DataType const> data, size_t increment = sizeof(DataType)) override
+    {
+        this->record(Call{ start_addr, data.size(), increment });
+        this->SparseMemoryRegisterTarget::seqWrite(start_addr, data, increment);
+    }
+    virtual void seqRead(AddressType start_addr, std::span<DataType> out_data, size_t increment = sizeof(DataType)) override
+    {
+        this->record(Call{ start_addr, out_data.size(), increment });
+        this->SparseMemoryRegisterTarget::seqRead(start_addr, out_data, increment);
+    }
+    virtual void compWrite(std::span<std::pair<AddressType, DataType> const> addr_data) override
+    {
+        {
+            std::lock_guard lg{ this->mtx };
+            for (auto const& [addr, data] : addr_data)
+                this->comp_addresses.push_back(addr);
+        }
+        this->SparseMemoryRegisterTarget::compWrite(addr_data);
+    }
+    virtual void compRead(std::span<AddressType const> const addresses, std::span<DataType> out_data) override
+    {
+        {
+            std::lock_guard lg{ this->mtx };
+            this->comp_addresses.insert(this->comp_addresses.end(), addresses.begin(), addresses.end());
+        }
+        this->SparseMemoryRegisterTarget::compRead(addresses, out_data);
+    }
+    void clear()
+    {
+        this->calls.clear();
+        this->comp_addresses.clear();
+    }
+
+    std::vector<Call> calls;
+    std::vector<AddressType> comp_addresses;
+
+private:
+    void record(Call call)
+    {
+        std::lock_guard lg{ this->mtx };
+        this->calls.push_back(call);
+    }
+    std::mutex mtx;
+};
+
+class FailingTarget : public RAP::RTF::SparseMemoryRegisterTarget<Cfg>
+{
+public:
+    using SparseMemoryRegisterTarget::SparseMemoryRegisterTarget;
+    virtual void seqRead(AddressType, std::span<DataType>, size_t = sizeof(DataType)) override
+    {
+        throw std::runtime_error("backend failed");
+    }
+    virtual void compRead(std::span<AddressType const> const, std::span<DataType>) override
+    {
+        throw std::runtime_error("backend failed");
+    }
+};
+
+bool sameCall(RecordingTarget::Call const& call, AddressType addr, size_t count, size_t increment = sizeof(DataType))
+{
+    return call.addr == addr && call.count == count && call.increment == increment;
+}
+
+// `parallel_threshold` decides whether sub-batches run on their own tasks; the results must not depend on it.
+void testSplitAndReassembly(size_t parallel_threshold)
+{
+    RAP::RTF::RouterRegisterTarget<Cfg> router("router", { .parallel_threshold = parallel_threshold });
+    auto const a = std::make_shared<RecordingTarget>("a");
+    auto const b = std::make_shared<RecordingTarget>("b");
+    auto const c = std::make_shared<RecordingTarget>("c");
+    router.addRoute(0x000, 0x100, a);
+    router.addRoute(0x100, 0x100, b);
+    router.addRoute(0x200, 0x100, c);
+
+    // A sequential write over all three routes becomes one sub-batch per backend, at backend-relative addresses.
+    std::vector<DataType> data(0xC0);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<DataType>(0x1000 + i);
+    router.seqWrite(0x000, data);
+    CHECK(a->calls.size() == 1 && sameCall(a->calls[0], 0x000, 0x40));
+    CHECK(b->calls.size() == 1 && sameCall(b->calls[0], 0x000, 0x40));
+    CHECK(c->calls.size() == 1 && sameCall(c->calls[0], 0x000, 0x40));
+    CHECK(a->read(0x0FC) == 0x103F);
+    CHECK(b->read(0x000) == 0x1040);
+    CHECK(c->read(0x0FC) == 0x10BF);
+
+    // Reading it back reassembles the pieces in order.
+    std::vector<DataType> out(data.size());
+    router.seqRead(0x000, out);
+    CHECK(out == data);
+
+    // A run that starts mid-route is split at the route boundary.
+    std::vector<DataType> middle(0x10);
+    router.seqRead(0x1F8, middle);
+    CHECK(sameCall(b->calls.back(), 0x0F8, 2));
+    CHECK(sameCall(c->calls.back(), 0x000, 14));
+    CHECK(std::equal(middle.begin(), middle.end(), data.begin() + 0x1F8 / 4));
+
+    // With a stride, each backend gets the registers that fall inside its route.
+    a->clear();
+    b->clear();
+    router.seqWrite(0x0F8, std::vector<DataType>{ 1, 2, 3, 4 }, 8);
+    CHECK(a->calls.size() == 1 && sameCall(a->calls[0], 0x0F8, 1, 8));
+    CHECK(b->calls.size() == 1 && sameCall(b->calls[0], 0x000, 3, 8));
+    CHECK(a->read(0x0F8) == 1 && a->read(0x0FC) == 0x103F);
+    CHECK(b->read(0x000) == 2 && b->read(0x004) == 0x1041 && b->read(0x008) == 3 && b->read(0x010) == 4);
+
+    // Compressed batches keep the caller's order, both within each backend and in the results.
+    a->clear();
+    b->clear();
+    c->clear();
+    std::vector<std::pair<AddressType, DataType>> const addr_data{ { 0x204, 1 }, { 0x008, 2 }, { 0x104, 3 }, { 0x000, 4 }, { 0x200, 5 } };
+    router.compWrite(addr_data);
+    CHECK((a->comp_addresses == std::vector<AddressType>{ 0x008, 0x000 }));
+    CHECK((b->comp_addresses == std::vector<AddressType>{ 0x004 }));
+    CHECK((c->comp_addresses == std::vector<AddressType>{ 0x004, 0x000 }));
+    std::vector<AddressType> const addresses{ 0x200, 0x000, 0x104, 0x008, 0x204 };
+    std::vector<DataType> comp_out(addresses.size());
+    router.compRead(addresses, comp_out);
+    CHECK((comp_out == std::vector<DataType>{ 5, 4, 3, 2, 1 }));
+}
+
+}
+
+int main()
+{
+    testSplitAndReassembly(256);
+    testSplitAndReassembly(1);
+
+    RAP::RTF::RouterRegisterTarget<Cfg> router("router", { .parallel_threshold = 1 });
+    auto const a = std::make_shared<RecordingTarget>("a");
+    auto const failing = std::make_shared<FailingTarget>("failing");
+    router.addRoute(0x000, 0x100, a);
+    router.addRoute(0x200, 0x100, failing);
+
+    // Bad routes are rejected.
+    CHECK_THROWS(router.addRoute(0x080, 0x100, a), RAP::Exception);
+    CHECK_THROWS(router.addRoute(0x1F0, 0x20, a), RAP::Exception);
+    CHECK_THROWS(router.addRoute(0x100, 0, a), RAP::Exception);
+    CHECK_THROWS(router.addRoute(0x100, 0x100, nullptr), RAP::Exception);
+
+    // Unrouted addresses, including a hole inside a transfer, are rejected.
+    CHECK_THROWS((void)router.read(0x100), RAP::Exception);
+    CHECK_THROWS((void)router.read(0x300), RAP::Exception);
+    std::vector<DataType> out(0x80);
+    CHECK_THROWS(router.seqRead(0x000, out), RAP::Exception);
+
+    // An error in one sub-batch reaches the caller after the others have finished.
+    a->clear();
+    std::vector<DataType> spanning(0x10);
+    router.addRoute(0x100, 0x100, std::make_shared<RecordingTarget>("b"));
+    CHECK_THROWS(router.seqRead(0x1F8, spanning), std::runtime_error);
+    CHECK_THROWS(router.compRead(std::vector<AddressType>{ 0x000, 0x200 }, std::span{ spanning }.first(2)), std::runtime_error);
+    return RAP::Test::result();
+}
@@ -0,0 +1,67 @@
+#include "RttEstimator.h"
+#include "Check.h"
+#include <chrono>
+
+using namespace std::chrono_literals;
+
+int main()
+{
+    // Before the first sample, the initial timeout applies.
+    RAP::RttEstimator defaults;
+    CHECK(!defaults.hasSample());
+    CHECK(defaults.getTimeout() == 1s);
+
+    RAP::RetryPolicy policy;
+    policy.initial_timeout = 50ms;
+    policy.min_timeout = 1us;
+    policy.max_timeout = 2ms;
+    RAP::RttEstimator rtt(policy);
+    CHECK(rtt.getTimeout() == 2ms);
+
+    // First sample: SRTT = R, RTTVAR = R / 2, RTO = SRTT + 4 * RTTVAR.
+    rtt.addSample(100us);
+    CHECK(rtt.hasSample());
+    CHECK(rtt.getSmoothedRtt() == 100us);
+    CHECK(rtt.getRttVariation() == 50us);
+    CHECK(rtt.getTimeout() == 300us);
+
+    // Later samples: RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R, rounded up to whole microseconds.
+    rtt.addSample(200us);
+    CHECK(rtt.getRttVariation() == 62500ns);
+    CHECK(rtt.getSmoothedRtt() == 112500ns);
+    CHECK(rtt.getTimeout() == 363us);
+
+    // Each expiry doubles the timeout, up to the maximum.
+    rtt.backoff();
+    CHECK(rtt.getTimeout() == 726us);
+    rtt.backoff();
+    rtt.backoff();
+    CHECK(rtt.getTimeout() == 2ms);
+    rtt.backoff();
+    CHECK(rtt.getTimeout() == 2ms);
+    // A new sample ends the backoff.
+    rtt.addSample(112500ns);
+    CHECK(rtt.getTimeout() < 726us);
+
+    // A steady RTT drives RTTVAR to zero; the clock granularity keeps the timeout above SRTT.
+    for (int i = 0; i < 200; i++)
+        rtt.addSample(80us);
+    CHECK(rtt.getRttVariation() == 0ns);
+    CHECK(rtt.getSmoothedRtt() == 80us);
+    CHECK(rtt.getTimeout() == 81us);
+
+    // The timeout stays within the policy's bounds.
+    rtt.addSample(10ms);
+    CHECK(rtt.getTimeout() == 2ms);
+    policy.min_timeout = 1ms;
+    RAP::RttEstimator floored(policy);
+    floored.addSample(10us);
+    CHECK(floored.getTimeout() == 1ms);
+
+    // reset() forgets the samples.
+    rtt.reset();
+    CHECK(!rtt.hasSample());
+    CHECK(rtt.getSmoothedRtt() == 0ns);
+    CHECK(rtt.getTimeout() == 2ms);
+    return RAP::Test::result();
+}
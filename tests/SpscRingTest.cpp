@@ -0,0 +1,107 @@
+#include "SpscRing.h"
+#include "Check.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+using Ring = RAP::Transport::SpscRing<RAP::Transport::CvParker>;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr uint32_t SlotCount = 4;
+constexpr size_t MaxMessageSize = 16;
+
+struct FreeDeleter {
+    void operator()(void* p) const { std::free(p); }
+};
+std::unique_ptr<void, FreeDeleter> allocate()
+{
+    auto const bytes = (Ring::requiredBytes(SlotCount, MaxMessageSize) + 63) & ~size_t{ 63 };
+    return std::unique_ptr<void, FreeDeleter>{ std::aligned_alloc(64, bytes) };
+}
+
+RAP::Buffer message(uint8_t first, size_t size)
+{
+    RAP::Buffer buffer(size);
+    for (size_t i = 0; i < size; i++)
+        buffer[i] = static_cast<uint8_t>(first + i);
+    return buffer;
+}
+RAP::Buffer pop(Ring& ring)
+{
+    RAP::Buffer buffer;
+    ring.pop([&](RAP::BufferView m) { buffer.assign(m.begin(), m.end()); }, 1ms);
+    return buffer;
+}
+
+}
+
+int main()
+{
+    auto const memory = allocate();
+    CHECK_THROWS(Ring(memory.get(), 3, MaxMessageSize, true), RAP::Exception);
+
+    // No spinning, so the waits below park straight away.
+    Ring ring(memory.get(), SlotCount, MaxMessageSize, true, 0);
+
+    // Empty: pop times out.
+    CHECK_THROWS(pop(ring), RAP::Transport::TransportTimeoutException);
+
+    // Full: the push after SlotCount messages times out, and popping one makes room again.
+    for (uint8_t i = 0; i < SlotCount; i++)
+        ring.push(message(i, i), 1ms);
+    CHECK_THROWS(ring.push(message(9, 1), 1ms), RAP::Transport::TransportTimeoutException);
+    CHECK(pop(ring) == message(0, 0));
+    ring.push(message(9, 1), 1ms);
+    for (uint8_t i = 1; i < SlotCount; i++)
+        CHECK(pop(ring) == message(i, i));
+    CHECK(pop(ring) == message(9, 1));
+    CHECK_THROWS(pop(ring), RAP::Transport::TransportTimeoutException);
+
+    // Wrap: the indices go round the slots many times, with messages of every size up to the limit.
+    for (size_t i = 0; i < 10 * SlotCount; i++) {
+        auto const m = message(static_cast<uint8_t>(i), i % (MaxMessageSize + 1));
+        ring.push(m, 1ms);
+        ring.push(m, 1ms);
+        CHECK(pop(ring) == m);
+        CHECK(pop(ring) == m);
+    }
+
+    // Oversize messages are rejected without taking a slot.
+    CHECK_THROWS(ring.push(message(0, MaxMessageSize + 1), 1ms), RAP::MessageSizeException);
+    CHECK_THROWS(pop(ring), RAP::Transport::TransportTimeoutException);
+
+    // A message the consumer cannot take is still released.
+    ring.push(message(1, 4), 1ms);
+    ring.push(message(2, 4), 1ms);
+    CHECK_THROWS(ring.pop([](RAP::BufferView) { throw std::runtime_error("rejected"); }, 1ms), std::runtime_error);
+    CHECK(pop(ring) == message(2, 4));
+
+    // A stop request ends a waiting pop.
+    std::stop_source stop;
+    stop.request_stop();
+    CHECK(!ring.pop([](RAP::BufferView) {}, 1s, stop.get_token()));
+
+    // Across threads, with the producer regularly finding the ring full and the consumer finding it empty.
+    constexpr uint32_t Count = 100000;
+    std::jthread thread([&] {
+        for (uint32_t i = 0; i < Count; i++)
+            ring.push(RAP::BufferView{ reinterpret_cast<uint8_t const*>(&i), sizeof(i) }, 10s);
+    });
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < Count; i++) {
+        ring.pop([&](RAP::BufferView m) {
+            uint32_t value = ~i;
+            if (m.size() == sizeof(value))
+                std::memcpy(&value, m.data(), sizeof(value));
+            mismatches += value != i;
+        }, 10s);
+    }
+    CHECK(mismatches == 0);
+    return RAP::Test::result();
+}
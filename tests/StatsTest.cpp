@@ -0,0 +1,60 @@
+#include "Stats.h"
+#include "Check.h"
+#include <chrono>
+#include <cstdint>
+
+using RAP::LatencyHistogram;
+using namespace std::chrono_literals;
+
+int main()
+{
+    static_assert(LatencyHistogram::bucket_count == 272);
+
+    // Values below 8 ns get a bucket each.
+    for (uint64_t ns = 0; ns < LatencyHistogram::sub_buckets; ns++) {
+        CHECK(LatencyHistogram::bucketIndex(ns) == ns);
+        CHECK(LatencyHistogram::bucketUpperBound(ns) == ns);
+    }
+    // The buckets tile the range without gaps: each one ends just before the next begins, and its
+    // width is at most 1/8 of its lower bound.
+    for (size_t i = 0; i + 1 < LatencyHistogram::bucket_count; i++) {
+        auto const upper = LatencyHistogram::bucketUpperBound(i);
+        CHECK(LatencyHistogram::bucketIndex(upper) == i);
+        CHECK(LatencyHistogram::bucketIndex(upper + 1) == i + 1);
+        if (i >= LatencyHistogram::sub_buckets) {
+            auto const lower = LatencyHistogram::bucketUpperBound(i - 1) + 1;
+            CHECK((upper - lower + 1) * LatencyHistogram::sub_buckets <= lower);
+        }
+    }
+    CHECK(LatencyHistogram::bucketIndex(8) == 8);
+    CHECK(LatencyHistogram::bucketIndex(16) == 16);
+    CHECK(LatencyHistogram::bucketIndex(1000) == LatencyHistogram::bucketIndex(1023));
+    CHECK(LatencyHistogram::bucketIndex(1023) + 1 == LatencyHistogram::bucketIndex(1024));
+    // The last bucket also takes everything from 2^36 ns up.
+    CHECK(LatencyHistogram::bucketIndex((uint64_t{ 1 } << 36) - 1) == LatencyHistogram::bucket_count - 1);
+    CHECK(LatencyHistogram::bucketIndex(uint64_t{ 1 } << 36) == LatencyHistogram::bucket_count - 1);
+    CHECK(LatencyHistogram::bucketIndex(UINT64_MAX) == LatencyHistogram::bucket_count - 1);
+
+    // Recording and summarizing.
+    LatencyHistogram histogram;
+    CHECK(histogram.snapshot().count == 0);
+    CHECK(histogram.snapshot().percentileNs(50) == 0);
+    for (int i = 0; i < 90; i++)
+        histogram.record(1us);
+    for (int i = 0; i < 10; i++)
+        histogram.record(1ms);
+    histogram.record(-5ns);
+    auto const s = histogram.snapshot();
+    CHECK(s.count == 101);
+    CHECK(s.min_ns == 0);
+    CHECK(s.max_ns == 1'000'000);
+    CHECK(s.sum_ns == 90 * 1'000 + 10 * 1'000'000);
+    CHECK(s.buckets[0] == 1);
+    CHECK(s.buckets[LatencyHistogram::bucketIndex(1'000)] == 90);
+    // Percentiles are rounded up to the end of their bucket, but never past the largest sample.
+    CHECK(s.percentileNs(50) == LatencyHistogram::bucketUpperBound(LatencyHistogram::bucketIndex(1'000)));
+    CHECK(s.percentileNs(50) >= 1'000 && s.percentileNs(50) < 1'125);
+    CHECK(s.percentileNs(99) == 1'000'000);
+    CHECK(s.percentileNs(100) == 1'000'000);
+    return RAP::Test::result();
+}